@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vdif_batch.h"
+
+int main(int argc, char * const *argv) {
+	int opt;
+	int failed;
+	int jobs = 0;
+	int thread_count;
+	int device_limit = 1;
+	const char *index_dir = NULL;
+	BManifest_t manifest;
+	
+	thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc,argv,"ci:j:d:")) != -1) {
+		switch (opt) {
+			case 'c':
+				jobs |= BATCH_CHECK;
+				break;
+			case 'i':
+				jobs |= BATCH_INDEX;
+				index_dir = optarg;
+				break;
+			case 'j':
+				thread_count = atoi(optarg);
+				break;
+			case 'd':
+				device_limit = atoi(optarg);
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+	if (optind != argc-1 || thread_count < 1) {
+		fprintf(stdout,"Usage: %s [-c] [-i INDEXDIR] [-j THREADS] [-d PERDEVICE] MANIFEST\n",&argv[0][2]);
+		fprintf(stdout,"  Collects statistics on all recordings listed in MANIFEST, one file per line.\n");
+		fprintf(stdout,"  Scatter-gather files are grouped by scan name.\n");
+		fprintf(stdout,"    -c  also check scatter-gather block numbers\n");
+		fprintf(stdout,"    -i  write per-second packet index files to INDEXDIR\n");
+		fprintf(stdout,"    -j  number of worker threads (default: number of CPUs)\n");
+		fprintf(stdout,"    -d  recordings read concurrently per device, 0 for no limit (default: 1)\n");
+		return 1;
+	}
+	if (open_manifest_batch(argv[optind],&manifest) == -1) {
+		return 1;
+	}
+	failed = run_manifest_batch(&manifest,jobs,index_dir,thread_count,device_limit);
+	fprintf(stderr,"Processed %d recordings, %d failed\n",manifest.recording_count,failed);
+	close_manifest_batch(&manifest);
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "vdif_checksum.h"
+
+int main(int argc, char * const *argv) {
+	int opt;
+	int failed;
+	int num_files;
+	int thread_count;
+	int device_limit = 1;
+	
+	thread_count = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	while ((opt = getopt(argc,argv,"j:d:")) != -1) {
+		switch (opt) {
+			case 'j':
+				thread_count = atoi(optarg);
+				break;
+			case 'd':
+				device_limit = atoi(optarg);
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+	if (argc - optind < 2 || thread_count < 1 ||
+	  (strcmp(argv[optind],"gen") != 0 && strcmp(argv[optind],"verify") != 0)) {
+		fprintf(stdout,"Usage: %s [-j THREADS] [-d PERDEVICE] gen|verify FILE [ FILE [ ... ] ]\n",&argv[0][2]);
+		fprintf(stdout,"  Generates or verifies per-block CRC32C checksums stored in FILE%s.\n",CHECKSUM_SUFFIX);
+		fprintf(stdout,"    -j  number of worker threads (default: number of CPUs)\n");
+		fprintf(stdout,"    -d  files read concurrently per device, 0 for no limit (default: 1)\n");
+		return 1;
+	}
+	num_files = argc - optind - 1;
+	if (strcmp(argv[optind],"gen") == 0) {
+		failed = generate_files_cs(num_files,(const char **)&argv[optind+1],thread_count,device_limit);
+	} else {
+		failed = verify_files_cs(num_files,(const char **)&argv[optind+1],thread_count,device_limit);
+	}
+	fprintf(stderr,"Checked %d files, %d failed\n",num_files,failed);
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include <pthread.h>
+#include <string.h>
+
+#include "crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define CRC32C_HAVE_SSE42 1
+#endif
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+// reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82F63B78
+
+// slice-by-8 lookup tables, filled once on first use
+static uint32_t crc32c_table[8][256];
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT;
+
+/* Fill slice-by-8 lookup tables.
+ */
+static void init_table(void) {
+	int ii, jj;
+	uint32_t crc;
+	
+	for (ii=0; ii<256; ii++) {
+		crc = ii;
+		for (jj=0; jj<8; jj++) {
+			crc = (crc >> 1) ^ (CRC32C_POLY & (0 - (crc & 1)));
+		}
+		crc32c_table[0][ii] = crc;
+	}
+	for (ii=0; ii<256; ii++) {
+		crc = crc32c_table[0][ii];
+		for (jj=1; jj<8; jj++) {
+			crc = crc32c_table[0][crc & 0xFF] ^ (crc >> 8);
+			crc32c_table[jj][ii] = crc;
+		}
+	}
+}
+
+#ifdef CRC32C_HAVE_SSE42
+// 1 if the CPU has the SSE4.2 crc32 instruction, set once on first use
+static int have_sse42 = 0;
+static pthread_once_t have_sse42_once = PTHREAD_ONCE_INIT;
+
+/* Detect SSE4.2 support.
+ */
+static void init_sse42(void) {
+	have_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0;
+}
+
+/* CRC32C using the SSE4.2 crc32 instruction.
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const void *buf, size_t len) {
+	const uint8_t *p = (const uint8_t *)buf;
+	
+	crc = ~crc;
+	// align to 8 bytes
+	while (len > 0 && ((uintptr_t)p & 7) != 0) {
+		crc = _mm_crc32_u8(crc,*p++);
+		len--;
+	}
+#ifdef __x86_64__
+	{
+		uint64_t crc64 = crc;
+		uint64_t word;
+		
+		while (len >= 8) {
+			memcpy(&word,p,8);
+			crc64 = _mm_crc32_u64(crc64,word);
+			p += 8;
+			len -= 8;
+		}
+		crc = (uint32_t)crc64;
+	}
+#endif
+	while (len >= 4) {
+		uint32_t word;
+		
+		memcpy(&word,p,4);
+		crc = _mm_crc32_u32(crc,word);
+		p += 4;
+		len -= 4;
+	}
+	while (len > 0) {
+		crc = _mm_crc32_u8(crc,*p++);
+		len--;
+	}
+	return ~crc;
+}
+#endif
+
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len) {
+	const uint8_t *p = (const uint8_t *)buf;
+	uint32_t lo, hi;
+	
+	pthread_once(&crc32c_table_once,init_table);
+	crc = ~crc;
+	// align to 8 bytes
+	while (len > 0 && ((uintptr_t)p & 7) != 0) {
+		crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		len--;
+	}
+	// process 8 bytes per iteration, assumes little-endian
+	while (len >= 8) {
+		memcpy(&lo,p,4);
+		memcpy(&hi,p+4,4);
+		lo ^= crc;
+		crc = crc32c_table[7][lo & 0xFF] ^
+		  crc32c_table[6][(lo >> 8) & 0xFF] ^
+		  crc32c_table[5][(lo >> 16) & 0xFF] ^
+		  crc32c_table[4][lo >> 24] ^
+		  crc32c_table[3][hi & 0xFF] ^
+		  crc32c_table[2][(hi >> 8) & 0xFF] ^
+		  crc32c_table[1][(hi >> 16) & 0xFF] ^
+		  crc32c_table[0][hi >> 24];
+		p += 8;
+		len -= 8;
+	}
+	while (len > 0) {
+		crc = crc32c_table[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+		len--;
+	}
+	return ~crc;
+}
+
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len) {
+#ifdef CRC32C_HAVE_SSE42
+	pthread_once(&have_sse42_once,init_sse42);
+	if (have_sse42) {
+		return crc32c_hw(crc,buf,len);
+	}
+#endif
+	return crc32c_sw(crc,buf,len);
+}
@@ -0,0 +1,24 @@
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Update a CRC32C (Castagnoli) checksum with len bytes from buf.
+ * Arguments:
+ *  crc -- checksum of preceding data, 0 to start a new checksum
+ *  buf -- pointer to data
+ *  len -- number of bytes of data
+ * Returns:
+ *  crc -- checksum of preceding data and buf
+ * Notes:
+ *  Uses the SSE4.2 crc32 instruction if the CPU supports it, and a
+ *  slice-by-8 table lookup otherwise. Both give identical results.
+ */
+uint32_t crc32c(uint32_t crc, const void *buf, size_t len);
+
+/* Same as crc32c, but always uses the slice-by-8 implementation.
+ */
+uint32_t crc32c_sw(uint32_t crc, const void *buf, size_t len);
+
+#endif // CRC32C_H
@@ -0,0 +1,57 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vdif_extract.h"
+#include "vdif_files.h"
+
+int main(int argc, const char **argv) {
+	int fd_out;
+	int num_files;
+	int64_t packets;
+	uint32_t start_secs, end_secs;
+	FFile_t file;
+	SGGroup_t group;
+	
+	if (argc < 5) {
+		fprintf(stdout,"Usage: %s START_SECS END_SECS OUTFILE FILE [ FILE [ ... ] ]\n",&argv[0][2]);
+		fprintf(stdout,"  Copies packets with START_SECS <= secs_since_epoch < END_SECS from a flat\n");
+		fprintf(stdout,"  file, or a scatter-gather group, to flat file OUTFILE ('-' for stdout).\n");
+		return 1;
+	}
+	start_secs = (uint32_t)strtoul(argv[1],NULL,10);
+	end_secs = (uint32_t)strtoul(argv[2],NULL,10);
+	num_files = argc - 4;
+	if (argv[3][0] == '-' && argv[3][1] == '\0') {
+		fd_out = STDOUT_FILENO;
+	} else {
+		fd_out = open(argv[3],O_WRONLY|O_CREAT|O_TRUNC,0644);
+		if (fd_out == -1) {
+			perror("extract: unable to open output file");
+			return 1;
+		}
+	}
+	packets = -1;
+	if (is_file_sg(argv[4])) {
+		if (open_group_sg(num_files,&argv[4],&group) != -1) {
+			packets = extract_range_group_sg(&group,start_secs,end_secs,fd_out);
+			close_group_sg(&group);
+		}
+	} else if (num_files == 1) {
+		if (open_file_f(argv[4],&file) != -1) {
+			packets = extract_range_file_f(&file,start_secs,end_secs,fd_out);
+			close_file_f(&file);
+		}
+	} else {
+		fprintf(stderr,"extract: multiple files given, but '%s' is not scatter-gather\n",argv[4]);
+	}
+	if (fd_out != STDOUT_FILENO) {
+		close(fd_out);
+	}
+	if (packets == -1) {
+		return 1;
+	}
+	fprintf(stderr,"Extracted %lld packets\n",(long long)packets);
+	return 0;
+}
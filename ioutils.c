@@ -1,17 +1,30 @@
+#define _GNU_SOURCE
+#include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "ioutils.h"
 
+// size of user-space buffer used when kernel-side copies are not possible
+#define IOUTILS_COPY_BUFFER_SIZE (4*1024*1024)
+// maximum number of bytes moved per splice call
+#define IOUTILS_SPLICE_CHUNK_SIZE (1024*1024)
+// minimum number of consumed bytes dropped per POSIX_FADV_DONTNEED call
+#define IOUTILS_STREAM_DROP_CHUNK (8*1024*1024)
+// minimum time in seconds between consumption rate measurements
+#define IOUTILS_STREAM_RATE_INTERVAL 0.05
+
 int ioutils_read(int fd, void *buf, size_t count, size_t *bytes_read) {
-	size_t bytes;
+	ssize_t bytes;
 	
 	*bytes_read = 0;
 	while (*bytes_read < count) {
-		bytes = (size_t)read(fd,buf+*bytes_read,count-*bytes_read);
+		bytes = read(fd,buf+*bytes_read,count-*bytes_read);
 		if (bytes == 0) {
 			//~ fprintf(stderr,
 			  //~ "%s.%s(%d): End-of-file reached\n",
@@ -25,3 +38,256 @@ int ioutils_read(int fd, void *buf, size_t count, size_t *bytes_read) {
 	}
 	return 1;
 }
+
+/* Test if errno after a failed copy_file_range or splice call means
+ * that the method is not supported for the given descriptors, in which
+ * case the next method should be tried.
+ * 
+ * Returns 1 if unsupported, 0 otherwise.
+ */
+static int is_unsupported_copy(int err) {
+	return err == EINVAL || err == EXDEV || err == ENOSYS ||
+	  err == EOPNOTSUPP || err == EBADF || err == ETXTBSY;
+}
+
+/* Copy using copy_file_range.
+ * 
+ * Returns 1 on success, 0 on end-of-file, -1 on error, and -2 if the
+ * method is not supported before any data was copied.
+ */
+static int copy_kernel(int fd_in, off_t offset, int fd_out, size_t count, size_t *copied) {
+	ssize_t bytes;
+	loff_t off_in = offset;
+	
+	while (*copied < count) {
+		bytes = copy_file_range(fd_in,&off_in,fd_out,NULL,count-*copied,0);
+		if (bytes == 0) {
+			return 0;
+		} else if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (*copied == 0 && is_unsupported_copy(errno)) {
+				return -2;
+			}
+			perror("ioutils_copy(copy_file_range)");
+			return -1;
+		}
+		*copied += bytes;
+	}
+	return 1;
+}
+
+/* Copy using splice, either directly if fd_out is a pipe, or through an
+ * intermediate pipe otherwise.
+ * 
+ * Returns 1 on success, 0 on end-of-file, -1 on error, and -2 if the
+ * method is not supported before any data was copied.
+ */
+static int copy_splice(int fd_in, off_t offset, int fd_out, size_t count, size_t *copied) {
+	int rv = 1;
+	int pfd[2] = {-1, -1};
+	int fd_via;
+	ssize_t bytes, bytes_out;
+	size_t chunk;
+	loff_t off_in = offset;
+	struct stat st;
+	
+	if (fstat(fd_out,&st) == -1) {
+		return -2;
+	}
+	if (S_ISFIFO(st.st_mode)) {
+		fd_via = fd_out;
+	} else {
+		if (pipe(pfd) == -1) {
+			return -2;
+		}
+		fd_via = pfd[1];
+	}
+	while (*copied < count) {
+		chunk = count - *copied;
+		if (chunk > IOUTILS_SPLICE_CHUNK_SIZE) {
+			chunk = IOUTILS_SPLICE_CHUNK_SIZE;
+		}
+		bytes = splice(fd_in,&off_in,fd_via,NULL,chunk,SPLICE_F_MOVE|SPLICE_F_MORE);
+		if (bytes == 0) {
+			rv = 0;
+			break;
+		} else if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			rv = (*copied == 0 && is_unsupported_copy(errno)) ? -2 : -1;
+			break;
+		}
+		// drain intermediate pipe
+		while (fd_via != fd_out && bytes > 0) {
+			bytes_out = splice(pfd[0],NULL,fd_out,NULL,bytes,SPLICE_F_MOVE|SPLICE_F_MORE);
+			if (bytes_out <= 0) {
+				if (bytes_out < 0 && errno == EINTR) {
+					continue;
+				}
+				// data is stuck in the pipe, cannot fall back anymore
+				rv = -1;
+				break;
+			}
+			bytes -= bytes_out;
+			*copied += bytes_out;
+		}
+		if (rv == -1) {
+			break;
+		}
+		if (fd_via == fd_out) {
+			*copied += bytes;
+		}
+	}
+	if (rv == -1) {
+		perror("ioutils_copy(splice)");
+	}
+	if (pfd[0] != -1) {
+		close(pfd[0]);
+		close(pfd[1]);
+	}
+	return rv;
+}
+
+/* Copy through a user-space buffer.
+ * 
+ * Returns 1 on success, 0 on end-of-file, -1 on error.
+ */
+static int copy_buffered(int fd_in, off_t offset, int fd_out, size_t count, size_t *copied) {
+	int rv = 1;
+	ssize_t bytes, bytes_out;
+	size_t chunk, done;
+	void *buf;
+	
+	buf = malloc(IOUTILS_COPY_BUFFER_SIZE);
+	if (buf == NULL) {
+		perror("ioutils_copy(malloc)");
+		return -1;
+	}
+	while (*copied < count) {
+		chunk = count - *copied;
+		if (chunk > IOUTILS_COPY_BUFFER_SIZE) {
+			chunk = IOUTILS_COPY_BUFFER_SIZE;
+		}
+		bytes = pread(fd_in,buf,chunk,offset + *copied);
+		if (bytes == 0) {
+			rv = 0;
+			break;
+		} else if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("ioutils_copy(pread)");
+			rv = -1;
+			break;
+		}
+		done = 0;
+		while (done < (size_t)bytes) {
+			bytes_out = write(fd_out,buf+done,bytes-done);
+			if (bytes_out < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				perror("ioutils_copy(write)");
+				rv = -1;
+				break;
+			}
+			done += bytes_out;
+		}
+		*copied += done;
+		if (rv == -1) {
+			break;
+		}
+	}
+	free(buf);
+	return rv;
+}
+
+int ioutils_copy(int fd_in, off_t offset, int fd_out, size_t count, size_t *copied) {
+	int rv;
+	
+	*copied = 0;
+	rv = copy_kernel(fd_in,offset,fd_out,count,copied);
+	if (rv != -2) {
+		return rv;
+	}
+	rv = copy_splice(fd_in,offset,fd_out,count,copied);
+	if (rv != -2) {
+		return rv;
+	}
+	return copy_buffered(fd_in,offset,fd_out,count,copied);
+}
+
+/* Return monotonic time in seconds.
+ */
+static double stream_time(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+}
+
+void ioutils_stream_init(int fd, IOStream_t *stream, off_t offset) {
+	stream->enabled = 1;
+	stream->window = IOUTILS_STREAM_WINDOW_MIN;
+	stream->rate = 0.0;
+	stream->last_offset = offset;
+	stream->last_time = stream_time();
+	// never drop data that was read before streaming was enabled
+	stream->behind = offset;
+	stream->ahead = offset;
+	posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL);
+	ioutils_stream_advance(fd,stream,offset);
+}
+
+void ioutils_stream_advance(int fd, IOStream_t *stream, off_t offset) {
+	double now, rate, window;
+	off_t page_mask, drop_end;
+	
+	if (!stream->enabled) {
+		return;
+	}
+	// update rate estimate and size window from it
+	now = stream_time();
+	if (now - stream->last_time >= IOUTILS_STREAM_RATE_INTERVAL && offset > stream->last_offset) {
+		rate = (double)(offset - stream->last_offset) / (now - stream->last_time);
+		stream->rate = stream->rate == 0.0 ? rate : 0.75*stream->rate + 0.25*rate;
+		stream->last_offset = offset;
+		stream->last_time = now;
+		window = stream->rate * IOUTILS_STREAM_LOOKAHEAD;
+		if (window < IOUTILS_STREAM_WINDOW_MIN) {
+			window = IOUTILS_STREAM_WINDOW_MIN;
+		} else if (window > IOUTILS_STREAM_WINDOW_MAX) {
+			window = IOUTILS_STREAM_WINDOW_MAX;
+		}
+		stream->window = (size_t)window;
+	}
+	// request more data once less than half a window is outstanding
+	if (stream->ahead < offset) {
+		stream->ahead = offset;
+	}
+	if (stream->ahead - offset < (off_t)stream->window/2) {
+		posix_fadvise(fd,stream->ahead,offset + stream->window - stream->ahead,POSIX_FADV_WILLNEED);
+		stream->ahead = offset + stream->window;
+	}
+	// drop consumed data in page-aligned chunks
+	page_mask = ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+	drop_end = offset & page_mask;
+	if (drop_end - stream->behind >= IOUTILS_STREAM_DROP_CHUNK) {
+		posix_fadvise(fd,stream->behind,drop_end - stream->behind,POSIX_FADV_DONTNEED);
+		stream->behind = drop_end;
+	}
+}
+
+void ioutils_stream_close(int fd, IOStream_t *stream, off_t offset) {
+	if (!stream->enabled) {
+		return;
+	}
+	if (offset > stream->behind) {
+		posix_fadvise(fd,stream->behind,offset - stream->behind,POSIX_FADV_DONTNEED);
+	}
+	posix_fadvise(fd,0,0,POSIX_FADV_NORMAL);
+	stream->enabled = 0;
+}
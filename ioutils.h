@@ -1,6 +1,36 @@
 #ifndef IOUTILS_H
 #define IOUTILS_H
 
+#include <sys/types.h>
+
+/* Bounds on the read-ahead window in streaming mode, and the time span
+ * of data at the observed consumption rate that the window should
+ * cover.
+ */
+#define IOUTILS_STREAM_WINDOW_MIN (4*1024*1024)
+#define IOUTILS_STREAM_WINDOW_MAX (256*1024*1024)
+#define IOUTILS_STREAM_LOOKAHEAD 0.5
+
+/* Keeps read-ahead and drop-behind state for a file that is scanned once
+ * from start to end, so that the page cache footprint stays bounded.
+ */
+typedef struct IOStream {
+	// 1 if streaming mode is enabled, 0 otherwise
+	int enabled;
+	// end of range already advised as needed
+	off_t ahead;
+	// end of range already dropped from page cache
+	off_t behind;
+	// current read-ahead window in bytes
+	size_t window;
+	// file offset at last rate measurement
+	off_t last_offset;
+	// monotonic time in seconds at last rate measurement
+	double last_time;
+	// smoothed consumption rate in bytes per second
+	double rate;
+} IOStream_t;
+
 /* Read count bytes from file described by fd into buf.
  * Arguments:
  *  fd -- descriptor for file opened in read-mode
@@ -14,4 +44,53 @@
  */
 int ioutils_read(int fd, void *buf, size_t count, size_t *read);
 
+/* Copy count bytes starting at offset in file described by fd_in to the
+ * current position in file described by fd_out.
+ * Arguments:
+ *  fd_in -- descriptor for file opened in read-mode
+ *  offset -- byte offset in fd_in where copy should start
+ *  fd_out -- descriptor for file or pipe opened in write-mode
+ *  count -- number of bytes to copy
+ *  copied -- pointer to memory where number of copied bytes should be
+ *            stored
+ * Returns:
+ *  rv -- 1 on success, 0 on end-of-file reached, -1 on error
+ * Notes:
+ *  Data is moved inside the kernel using copy_file_range if possible,
+ *  otherwise splice is tried, and as a last resort the data is copied
+ *  through a large user-space buffer. The file offset of fd_in is not
+ *  changed, the file offset of fd_out is advanced by the copy.
+ */
+int ioutils_copy(int fd_in, off_t offset, int fd_out, size_t count, size_t *copied);
+
+/* Enable streaming mode for the file described by fd.
+ * Arguments:
+ *  fd -- descriptor for file opened in read-mode
+ *  stream -- pointer to IOStream_t that keeps the streaming state
+ *  offset -- current file offset
+ * Notes:
+ *  The kernel is told that access is sequential, and a first read-ahead
+ *  window starting at offset is requested.
+ */
+void ioutils_stream_init(int fd, IOStream_t *stream, off_t offset);
+
+/* Update streaming state after data up to offset has been consumed.
+ * Arguments:
+ *  fd -- descriptor for file opened in read-mode
+ *  stream -- pointer to IOStream_t that keeps the streaming state
+ *  offset -- current file offset, all data before it is consumed
+ * Notes:
+ *  The read-ahead window is sized from the observed consumption rate,
+ *  and is requested with POSIX_FADV_WILLNEED ahead of offset once the
+ *  data already requested runs low. Consumed data is dropped from the
+ *  page cache with POSIX_FADV_DONTNEED. Does nothing if streaming mode
+ *  is not enabled.
+ */
+void ioutils_stream_advance(int fd, IOStream_t *stream, off_t offset);
+
+/* Disable streaming mode, dropping all consumed data up to offset from
+ * the page cache.
+ */
+void ioutils_stream_close(int fd, IOStream_t *stream, off_t offset);
+
 #endif // IOUTILS_H
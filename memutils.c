@@ -0,0 +1,173 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "memutils.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+// memory policy mode for mbind, from linux/mempolicy.h
+#define MEMUTILS_MPOL_BIND 2
+
+// size of the header in front of every buffer, keeps the buffer aligned
+// to cache lines
+#define MEMUTILS_PREFIX_SIZE 64
+
+/* Header stored in front of every buffer returned by memutils_alloc.
+ */
+typedef struct MPrefix {
+	// mapped size in bytes including the header, 0 if from malloc
+	size_t size;
+} MPrefix_t;
+
+// current policy
+static int policy_flags = 0;
+static int policy_node = MEMUTILS_NODE_ANY;
+
+/* Map anonymous memory aligned to huge pages, and ask for transparent
+ * huge pages if requested.
+ * 
+ * Returns pointer to memory, or NULL on failure.
+ */
+static void *map_aligned(size_t size, int huge) {
+	uintptr_t start, aligned;
+	void *ptr;
+	
+	// over-allocate by one huge page and trim the unaligned ends
+	ptr = mmap(NULL,size + MEMUTILS_HUGE_PAGE_SIZE,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if (ptr == MAP_FAILED) {
+		return NULL;
+	}
+	start = (uintptr_t)ptr;
+	aligned = (start + MEMUTILS_HUGE_PAGE_SIZE - 1) & ~((uintptr_t)MEMUTILS_HUGE_PAGE_SIZE - 1);
+	if (aligned > start) {
+		munmap(ptr,aligned - start);
+	}
+	if (start + MEMUTILS_HUGE_PAGE_SIZE > aligned) {
+		munmap((void *)(aligned + size),start + MEMUTILS_HUGE_PAGE_SIZE - aligned);
+	}
+	ptr = (void *)aligned;
+#ifdef MADV_HUGEPAGE
+	if (huge) {
+		madvise(ptr,size,MADV_HUGEPAGE);
+	}
+#endif
+	return ptr;
+}
+
+/////////////////////////////////////////////////////////////// ALLOCATOR
+
+void memutils_set_policy(int flags, int numa_node) {
+	policy_flags = flags;
+	policy_node = numa_node;
+}
+
+int memutils_numa_node(void) {
+	return policy_node;
+}
+
+void *memutils_alloc(size_t size) {
+	int huge;
+	unsigned long nodemask[16];
+	void *ptr = MAP_FAILED;
+	
+	huge = policy_flags & MEMUTILS_HUGE_PAGES;
+	if ((!huge && policy_node == MEMUTILS_NODE_ANY) || size < MEMUTILS_MMAP_THRESHOLD) {
+		ptr = malloc(size + MEMUTILS_PREFIX_SIZE);
+		if (ptr == NULL) {
+			return NULL;
+		}
+		((MPrefix_t *)ptr)->size = 0;
+		return (char *)ptr + MEMUTILS_PREFIX_SIZE;
+	}
+	// round up to whole huge pages
+	size = (size + MEMUTILS_PREFIX_SIZE + MEMUTILS_HUGE_PAGE_SIZE - 1) & ~((size_t)MEMUTILS_HUGE_PAGE_SIZE - 1);
+#ifdef MAP_HUGETLB
+	if (huge) {
+		ptr = mmap(NULL,size,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB,-1,0);
+	}
+#endif
+	if (ptr == MAP_FAILED) {
+		ptr = map_aligned(size,huge);
+		if (ptr == NULL) {
+			return NULL;
+		}
+	}
+	// bind before first touch, so that pages are placed on the node
+	if (policy_node >= 0 && policy_node < (int)(8*sizeof(nodemask))) {
+		memset(nodemask,0,sizeof(nodemask));
+		nodemask[policy_node / (8*sizeof(unsigned long))] |= 1UL << (policy_node % (8*sizeof(unsigned long)));
+		if (syscall(SYS_mbind,ptr,size,MEMUTILS_MPOL_BIND,nodemask,8*sizeof(nodemask),0) == -1) {
+			perror("memutils_alloc(mbind)");
+		}
+	}
+	((MPrefix_t *)ptr)->size = size;
+	return (char *)ptr + MEMUTILS_PREFIX_SIZE;
+}
+
+void memutils_free(void *ptr) {
+	MPrefix_t *prefix;
+	
+	if (ptr == NULL) {
+		return;
+	}
+	prefix = (MPrefix_t *)((char *)ptr - MEMUTILS_PREFIX_SIZE);
+	if (prefix->size > 0) {
+		munmap(prefix,prefix->size);
+	} else {
+		free(prefix);
+	}
+}
+
+int memutils_bind_thread(int numa_node) {
+	int lo, hi, cpu;
+	int count = 0;
+	char path[128];
+	char *list, *token, *save;
+	char buf[4096];
+	FILE *fp;
+	cpu_set_t cpus;
+	
+	if (numa_node < 0) {
+		return 1;
+	}
+	// cpulist is a comma-separated list of ranges, e.g. "0-7,16-23"
+	snprintf(path,sizeof(path),"/sys/devices/system/node/node%d/cpulist",numa_node);
+	fp = fopen(path,"r");
+	if (fp == NULL || fgets(buf,sizeof(buf),fp) == NULL) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to read CPU list of NUMA node %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  numa_node);
+		if (fp != NULL) {
+			fclose(fp);
+		}
+		return -1;
+	}
+	fclose(fp);
+	CPU_ZERO(&cpus);
+	for (list=buf; (token = strtok_r(list,",\n",&save)) != NULL; list=NULL) {
+		if (sscanf(token,"%d-%d",&lo,&hi) == 1) {
+			hi = lo;
+		}
+		for (cpu=lo; cpu<=hi && cpu<CPU_SETSIZE; cpu++) {
+			CPU_SET(cpu,&cpus);
+			count++;
+		}
+	}
+	if (count == 0 || pthread_setaffinity_np(pthread_self(),sizeof(cpu_set_t),&cpus) != 0) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to bind thread to NUMA node %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  numa_node);
+		return -1;
+	}
+	return 1;
+}
@@ -0,0 +1,66 @@
+#ifndef MEMUTILS_H
+#define MEMUTILS_H
+
+#include <stddef.h>
+
+/* Allocation policy flags, combine with bitwise or.
+ *  MEMUTILS_HUGE_PAGES -- back large buffers with 2 MB pages, from the
+ *                         hugetlb pool if pages are reserved there, and
+ *                         with transparent huge pages otherwise
+ */
+#define MEMUTILS_HUGE_PAGES 0x01
+
+/* NUMA node value that means no binding.
+ */
+#define MEMUTILS_NODE_ANY -1
+
+/* Size of a huge page, and the minimum size of a buffer to which the
+ * policy is applied. Smaller buffers always come from malloc.
+ */
+#define MEMUTILS_HUGE_PAGE_SIZE (2*1024*1024)
+#define MEMUTILS_MMAP_THRESHOLD (1024*1024)
+
+/* Set the policy used by memutils_alloc for all library buffers.
+ * Arguments:
+ *  flags -- MEMUTILS_* flags, 0 for the default policy
+ *  numa_node -- node that buffers are bound to, or MEMUTILS_NODE_ANY
+ * Notes:
+ *  Under the default policy (flags 0 and MEMUTILS_NODE_ANY) all buffers
+ *  come from malloc. The policy should be set before buffers are
+ *  allocated, and applies to library threads started afterward.
+ */
+void memutils_set_policy(int flags, int numa_node);
+
+/* Return the NUMA node set in the policy, or MEMUTILS_NODE_ANY.
+ */
+int memutils_numa_node(void);
+
+/* Allocate size bytes according to the policy.
+ * Arguments:
+ *  size -- number of bytes to allocate
+ * Returns:
+ *  ptr -- pointer to allocated memory, or NULL on failure
+ * Notes:
+ *  Memory should be released with memutils_free, never with free, since
+ *  a small header is stored in front of every buffer. Under the default
+ *  policy the buffer itself comes from malloc. Library functions that
+ *  hand buffers to the caller, such as read_packets_from_* and
+ *  get_samples, allocate them here and provide a matching release
+ *  function.
+ */
+void *memutils_alloc(size_t size);
+
+/* Release memory allocated with memutils_alloc. Does nothing if ptr is
+ * NULL.
+ */
+void memutils_free(void *ptr);
+
+/* Restrict the calling thread to the CPUs of a NUMA node.
+ * Arguments:
+ *  numa_node -- node to run on, MEMUTILS_NODE_ANY does nothing
+ * Returns:
+ *  rv -- 1 on success, -1 on error
+ */
+int memutils_bind_thread(int numa_node);
+
+#endif // MEMUTILS_H
@@ -0,0 +1,108 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "r2dbe_vdif.h"
+#include "vdif_files.h"
+#include "vdif_pcal.h"
+#include "vdif_pipeline.h"
+
+/* Output function that prints every second to stdout.
+ */
+void print_second(const PCalSecond_t *second, void *arg) {
+	(void)arg;
+	print_second_pcal("",second);
+	fflush(stdout);
+}
+
+int main(int argc, char * const *argv) {
+	int opt;
+	int rv = 0;
+	int num_files;
+	int packet_size;
+	int is_sg;
+	int thread_count = 2;
+	double sample_rate = R2DBE_SAMPLE_RATE;
+	double spacing = 0.0;
+	double offset = 0.0;
+	FStream_t stream;
+	SGGroup_t group;
+	PCal_t pcal;
+	PLPipeline_t pipeline;
+	
+	while ((opt = getopt(argc,argv,"r:s:o:j:")) != -1) {
+		switch (opt) {
+			case 'r':
+				sample_rate = atof(optarg);
+				break;
+			case 's':
+				spacing = atof(optarg);
+				break;
+			case 'o':
+				offset = atof(optarg);
+				break;
+			case 'j':
+				thread_count = atoi(optarg);
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+	if (optind >= argc || spacing <= 0.0 || thread_count < 1) {
+		fprintf(stdout,"Usage: %s -s SPACING [-o OFFSET] [-r RATE] [-j THREADS] FILE [ FILE [ ... ] ]\n",&argv[0][2]);
+		fprintf(stdout,"  Prints per-second amplitude and phase of phase-cal tones in a list of flat\n");
+		fprintf(stdout,"  files, or a scatter-gather group, of real single-channel 2-bit data.\n");
+		fprintf(stdout,"    -s  tone spacing in Hz\n");
+		fprintf(stdout,"    -o  frequency of first tone in Hz (default: 0)\n");
+		fprintf(stdout,"    -r  sample rate in Hz (default: R2DBE sample rate)\n");
+		fprintf(stdout,"    -j  number of folding threads (default: 2)\n");
+		return 1;
+	}
+	if (init_pcal(&pcal,llround(sample_rate),llround(spacing),llround(offset),thread_count,print_second,NULL) == -1) {
+		return 1;
+	}
+	num_files = argc - optind;
+	is_sg = is_file_sg(argv[optind]);
+	if (is_sg) {
+		if (open_group_sg(num_files,(const char **)&argv[optind],&group) == -1) {
+			destroy_pcal(&pcal);
+			return 1;
+		}
+		set_streaming_group_sg(&group,1);
+		packet_size = group.packet_size;
+	} else {
+		if (open_stream_f(num_files,(const char **)&argv[optind],&stream) == -1) {
+			destroy_pcal(&pcal);
+			return 1;
+		}
+		set_streaming_stream_f(&stream,1);
+		packet_size = stream.packet_size;
+	}
+	if (pipeline_init(&pipeline,packet_size,PIPELINE_BATCH_PACKETS,PIPELINE_BATCH_COUNT) != -1) {
+		if (is_sg) {
+			pipeline_add_stage(&pipeline,"reader",pipeline_read_group_sg,&group);
+		} else {
+			pipeline_add_stage(&pipeline,"reader",pipeline_read_stream_f,&stream);
+		}
+		pipeline_add_stage(&pipeline,"pcal",stage_pcal,&pcal);
+		if (pipeline_run(&pipeline) == -1) {
+			fprintf(stderr,"pcal: pipeline failed\n");
+			rv = 1;
+		} else {
+			flush_pcal(&pcal);
+		}
+		print_pipeline("  ",&pipeline);
+		pipeline_destroy(&pipeline);
+	} else {
+		rv = 1;
+	}
+	if (is_sg) {
+		close_group_sg(&group);
+	} else {
+		close_stream_f(&stream);
+	}
+	destroy_pcal(&pcal);
+	return rv;
+}
@@ -0,0 +1,63 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "vdif_recover.h"
+
+int main(int argc, char * const *argv) {
+	int ii;
+	int opt;
+	int fd_out = -1;
+	int failed = 0;
+	int damaged = 0;
+	const char *out_filename = NULL;
+	RReport_t report;
+	
+	while ((opt = getopt(argc,argv,"o:")) != -1) {
+		switch (opt) {
+			case 'o':
+				out_filename = optarg;
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stdout,"Usage: %s [-o OUTFILE] FILE [ FILE [ ... ] ]\n",&argv[0][2]);
+		fprintf(stdout,"  Validates every header in flat or scatter-gather files, resynchronizes on\n");
+		fprintf(stdout,"  the next plausible header after damage, and reports skipped byte ranges.\n");
+		fprintf(stdout,"    -o  append recovered packets of all files, in file order, to flat file\n");
+		fprintf(stdout,"        OUTFILE ('-' for stdout)\n");
+		return 1;
+	}
+	if (out_filename != NULL) {
+		if (out_filename[0] == '-' && out_filename[1] == '\0') {
+			fd_out = STDOUT_FILENO;
+		} else {
+			fd_out = open(out_filename,O_WRONLY|O_CREAT|O_TRUNC,0644);
+			if (fd_out == -1) {
+				perror("recover: unable to open output file");
+				return 1;
+			}
+		}
+	}
+	for (ii=optind; ii<argc; ii++) {
+		if (recover_file_rc(argv[ii],fd_out,&report) == -1) {
+			failed++;
+		} else if (report.skipped_ranges > 0) {
+			damaged++;
+		}
+		// keep stdout clean for packet data
+		if (fd_out != STDOUT_FILENO) {
+			print_report_rc("",&report);
+		}
+		free_report_rc(&report);
+	}
+	if (fd_out != -1 && fd_out != STDOUT_FILENO) {
+		close(fd_out);
+	}
+	fprintf(stderr,"Scanned %d files, %d damaged, %d failed\n",argc-optind,damaged,failed);
+	return failed == 0 ? 0 : 1;
+}
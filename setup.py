@@ -0,0 +1,24 @@
+from setuptools import setup, Extension
+
+# The extension is built from the library sources directly, so that no
+# shared library has to be installed alongside it.
+vdif = Extension(
+    'vdif',
+    sources=[
+        'vdifmodule.c',
+        'r2dbe_vdif.c',
+        'vdif_files.c',
+        'vdif_frames.c',
+        'ioutils.c',
+        'memutils.c',
+    ],
+    extra_compile_args=['-O2'],
+    extra_link_args=['-pthread'],
+)
+
+setup(
+    name='vdif',
+    version='0.1',
+    description='Python bindings for vdiftools readers and unpackers',
+    ext_modules=[vdif],
+)
@@ -7,25 +7,27 @@
 int main(int argc, const char **argv) {
 	int ii;
 	int num_packets;
+	int num_files;
 	int packets_read;
 	int pkt_size_8byte;
-	FFile_t file;
+	FStream_t stream;
 	vdif_header_t *pkt1, *pkt2;
 	void *buf;
 	
 	if (argc < 3) {
-		fprintf(stdout,"Usage: %s NUMPACKETS FLATFILE\n",&argv[0][2]);
+		fprintf(stdout,"Usage: %s NUMPACKETS FLATFILE [ FLATFILE [ ... ] ]\n",&argv[0][2]);
 		return 1;
 	}
 	num_packets = atoi(argv[1]);
-	if (open_file_f(argv[2],&file) != -1) {
+	num_files = argc - 2;
+	if (open_stream_f(num_files,&argv[2],&stream) != -1) {
 		packets_read = 0;
 		while (packets_read<num_packets) {
 			if (num_packets-packets_read<2000) {
-				ii = read_packets_from_file_f(&file,num_packets-packets_read,&buf);
+				ii = read_packets_from_stream_f(&stream,num_packets-packets_read,&buf);
 				packets_read += ii;
 			} else {
-				ii = read_packets_from_file_f(&file,2000,&buf);
+				ii = read_packets_from_stream_f(&stream,2000,&buf);
 				packets_read += ii;
 			}
 			if (ii==0) {
@@ -37,9 +39,9 @@ int main(int argc, const char **argv) {
 			fprintf(stdout,"VDIF time is %d@%d+%d .. %d@%d+%d\n",
 			  pkt1->ref_epoch,pkt1->secs_since_epoch,pkt1->data_frame,
 			  pkt2->ref_epoch,pkt2->secs_since_epoch,pkt2->data_frame);
-			free(buf);
+			free_packets_stream_f(buf);
 		}
-		close_file_f(&file);
+		close_stream_f(&stream);
 	}
 	return 0;
 }
@@ -0,0 +1,111 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "memutils.h"
+#include "vdif_files.h"
+#include "vdif_pipeline.h"
+
+/* User stage that accumulates a histogram of 2-bit sample values.
+ */
+int histogram(void *arg, PLBatch_t *batch) {
+	size_t ii;
+	size_t count;
+	uint64_t *hist = (uint64_t *)arg;
+	
+	count = (size_t)batch->packet_count*batch->samples_per_packet;
+	for (ii=0; ii<count; ii++) {
+		hist[batch->samples[ii] & 0x3]++;
+	}
+	return 1;
+}
+
+int main(int argc, char * const *argv) {
+	int ii;
+	int opt;
+	int rv = 0;
+	int mem_flags = 0;
+	int numa_node = MEMUTILS_NODE_ANY;
+	int fd_out;
+	int num_files;
+	int packet_size;
+	int is_sg;
+	uint64_t hist[4] = {0, 0, 0, 0};
+	FStream_t stream;
+	SGGroup_t group;
+	PLFilter_t filter = {pipeline_accept_valid, NULL};
+	PLPipeline_t pipeline;
+	
+	while ((opt = getopt(argc,argv,"Hn:")) != -1) {
+		switch (opt) {
+			case 'H':
+				mem_flags |= MEMUTILS_HUGE_PAGES;
+				break;
+			case 'n':
+				numa_node = atoi(optarg);
+				break;
+			default:
+				optind = argc;
+				break;
+		}
+	}
+	if (argc - optind < 2) {
+		fprintf(stdout,"Usage: %s [-H] [-n NODE] OUTFILE FILE [ FILE [ ... ] ]\n",&argv[0][2]);
+		fprintf(stdout,"  Runs read -> filter -> unpack -> histogram -> write pipeline on a list\n");
+		fprintf(stdout,"  of flat files, or a scatter-gather group, writing valid packets to OUTFILE.\n");
+		fprintf(stdout,"    -H  back buffers with huge pages\n");
+		fprintf(stdout,"    -n  allocate buffers on, and run stages on, NUMA node NODE\n");
+		return 1;
+	}
+	memutils_set_policy(mem_flags,numa_node);
+	num_files = argc - optind - 1;
+	is_sg = is_file_sg(argv[optind+1]);
+	if (is_sg) {
+		if (open_group_sg(num_files,(const char **)&argv[optind+1],&group) == -1) {
+			return 1;
+		}
+		set_streaming_group_sg(&group,1);
+		packet_size = group.packet_size;
+	} else {
+		if (open_stream_f(num_files,(const char **)&argv[optind+1],&stream) == -1) {
+			return 1;
+		}
+		set_streaming_stream_f(&stream,1);
+		packet_size = stream.packet_size;
+	}
+	fd_out = open(argv[optind],O_WRONLY|O_CREAT|O_TRUNC,0644);
+	if (fd_out == -1) {
+		perror("testp: unable to open output file");
+		return 1;
+	}
+	if (pipeline_init(&pipeline,packet_size,PIPELINE_BATCH_PACKETS,PIPELINE_BATCH_COUNT) != -1) {
+		if (is_sg) {
+			pipeline_add_stage(&pipeline,"reader",pipeline_read_group_sg,&group);
+		} else {
+			pipeline_add_stage(&pipeline,"reader",pipeline_read_stream_f,&stream);
+		}
+		pipeline_add_stage(&pipeline,"filter",pipeline_filter_headers,&filter);
+		pipeline_add_stage(&pipeline,"unpack",pipeline_unpack,NULL);
+		pipeline_add_stage(&pipeline,"histogram",histogram,hist);
+		pipeline_add_stage(&pipeline,"writer",pipeline_write_fd,&fd_out);
+		if (pipeline_run(&pipeline) == -1) {
+			fprintf(stderr,"testp: pipeline failed\n");
+			rv = 1;
+		}
+		print_pipeline("  ",&pipeline);
+		for (ii=0; ii<4; ii++) {
+			fprintf(stdout,"Sample value %d: %llu\n",ii,(unsigned long long)hist[ii]);
+		}
+		pipeline_destroy(&pipeline);
+	} else {
+		rv = 1;
+	}
+	close(fd_out);
+	if (is_sg) {
+		close_group_sg(&group);
+	} else {
+		close_stream_f(&stream);
+	}
+	return rv;
+}
@@ -41,7 +41,7 @@ int main(int argc, const char **argv) {
 			fprintf(stdout,"VDIF time is %d@%d+%d .. %d@%d+%d\n",
 			  pkt1->ref_epoch,pkt1->secs_since_epoch,pkt1->data_frame,
 			  pkt2->ref_epoch,pkt2->secs_since_epoch,pkt2->data_frame);
-			free(buf);
+			free_packets_group_sg(buf);
 		}
 		close_group_sg(&group);
 	}
@@ -0,0 +1,380 @@
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memutils.h"
+#include "vdif_batch.h"
+#include "vdif_files.h"
+#include "vdif_frames.h"
+#include "workpool.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+/* Arguments passed to the job for a single recording.
+ */
+typedef struct BJob {
+	BRecording_t *recording;
+	int jobs;
+	const char *index_dir;
+} BJob_t;
+
+// serializes output of completed recordings
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Derive the scan name from a file path, which is the base name without
+ * extension. Memory is allocated for the name and should be freed after
+ * use.
+ */
+char *scan_name_batch(const char *path) {
+	const char *base;
+	char *name, *ext;
+	
+	base = strrchr(path,'/');
+	base = base == NULL ? path : base + 1;
+	name = (char *)malloc(strlen(base) + 1);
+	strcpy(name,base);
+	ext = strrchr(name,'.');
+	if (ext != NULL && ext != name) {
+		*ext = '\0';
+	}
+	return name;
+}
+
+/* Add a file to a recording.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int add_file_batch(BRecording_t *recording, const char *path) {
+	char **tmp;
+	
+	if (recording->file_count == recording->file_capacity) {
+		recording->file_capacity = recording->file_capacity > 0 ? 2*recording->file_capacity : 8;
+		tmp = (char **)realloc(recording->filenames,recording->file_capacity*sizeof(char *));
+		if (tmp == NULL) {
+			return -1;
+		}
+		recording->filenames = tmp;
+	}
+	recording->filenames[recording->file_count] = (char *)malloc(strlen(path) + 1);
+	strcpy(recording->filenames[recording->file_count],path);
+	recording->file_count++;
+	return 1;
+}
+
+/* Return the recording that a file belongs to, adding a new recording
+ * to the manifest if needed.
+ * 
+ * Returns pointer to recording, or NULL on failure.
+ */
+BRecording_t *find_recording_batch(BManifest_t *manifest, const char *path) {
+	int ii;
+	int is_sg;
+	char *name;
+	BRecording_t *tmp;
+	
+	is_sg = is_file_sg(path);
+	name = scan_name_batch(path);
+	// scatter-gather files of the same scan form a single recording
+	if (is_sg) {
+		for (ii=0; ii<manifest->recording_count; ii++) {
+			if (manifest->recordings[ii].is_sg &&
+			  strcmp(manifest->recordings[ii].name,name) == 0) {
+				free(name);
+				return &manifest->recordings[ii];
+			}
+		}
+	}
+	if (manifest->recording_count == manifest->recording_capacity) {
+		manifest->recording_capacity = manifest->recording_capacity > 0 ? 2*manifest->recording_capacity : 64;
+		tmp = (BRecording_t *)realloc(manifest->recordings,manifest->recording_capacity*sizeof(BRecording_t));
+		if (tmp == NULL) {
+			free(name);
+			return NULL;
+		}
+		manifest->recordings = tmp;
+	}
+	tmp = &manifest->recordings[manifest->recording_count++];
+	memset(tmp,0,sizeof(BRecording_t));
+	tmp->name = name;
+	tmp->is_sg = is_sg;
+	return tmp;
+}
+
+/* Count missing and duplicate block numbers in a scatter-gather group.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int check_blocks_batch(SGGroup_t *sggroup, BRecording_t *recording) {
+	int64_t ii;
+	int64_t block_count;
+	int64_t step;
+	SGBlockLoc_t *locs;
+	
+	block_count = index_blocks_group_sg(sggroup,&locs);
+	if (block_count == -1) {
+		return -1;
+	}
+	for (ii=1; ii<block_count; ii++) {
+		step = (int64_t)locs[ii].block_num - locs[ii-1].block_num;
+		if (step == 0) {
+			recording->duplicate_blocks++;
+		} else if (step > 1) {
+			recording->missing_blocks += step - 1;
+		}
+	}
+	free(locs);
+	return 1;
+}
+
+/* Scan packets from an open recording and update its counters. Index
+ * lines are written to index, if not NULL.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int scan_packets_batch(BRecording_t *recording, FFile_t *file, SGGroup_t *group, int packet_size, FILE *index) {
+	int ii;
+	int rv;
+	int thread_seen[1024];
+	int64_t index_secs = -1;
+	uint32_t prev_secs = 0, prev_frame = 0;
+	void *buf;
+	vdif_header_t *hdr;
+	
+	memset(thread_seen,0,sizeof(thread_seen));
+	buf = memutils_alloc((size_t)BATCH_READ_PACKETS*packet_size);
+	if (buf == NULL) {
+		return -1;
+	}
+	while (1) {
+		if (recording->is_sg) {
+			rv = read_packets_into_group_sg(group,BATCH_READ_PACKETS,buf);
+		} else {
+			rv = read_packets_into_file_f(file,BATCH_READ_PACKETS,buf);
+		}
+		if (rv <= 0) {
+			break;
+		}
+		for (ii=0; ii<rv; ii++) {
+			hdr = (vdif_header_t *)(buf + (size_t)ii*packet_size);
+			if (recording->packets == 0) {
+				recording->first_secs = hdr->secs_since_epoch;
+			} else if (hdr->secs_since_epoch < prev_secs ||
+			  (hdr->secs_since_epoch == prev_secs && hdr->data_frame < prev_frame)) {
+				recording->time_reversals++;
+			}
+			if (hdr->invalid_data) {
+				recording->invalid_packets++;
+			}
+			if ((int)hdr->frame_length*8 != packet_size) {
+				recording->bad_frame_lengths++;
+			}
+			if (!thread_seen[hdr->thread_id]) {
+				thread_seen[hdr->thread_id] = 1;
+				recording->thread_count++;
+			}
+			if (index != NULL && (int64_t)hdr->secs_since_epoch > index_secs) {
+				index_secs = hdr->secs_since_epoch;
+				fprintf(index,"%u %lld\n",hdr->secs_since_epoch,(long long)recording->packets);
+			}
+			prev_secs = hdr->secs_since_epoch;
+			prev_frame = hdr->data_frame;
+			recording->last_secs = prev_secs;
+			recording->packets++;
+		}
+	}
+	memutils_free(buf);
+	return rv == -1 ? -1 : 1;
+}
+
+/* Run all requested jobs on a single recording, in one pass.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int run_recording_batch(BJob_t *job) {
+	int rv = 1;
+	int packet_size;
+	char path[PATH_MAX];
+	BRecording_t *recording = job->recording;
+	FFile_t file;
+	SGGroup_t group;
+	FILE *index = NULL;
+	
+	// open recording in streaming mode, it is read only once
+	if (recording->is_sg) {
+		if (open_group_sg(recording->file_count,(const char **)recording->filenames,&group) == -1) {
+			return -1;
+		}
+		set_streaming_group_sg(&group,1);
+		packet_size = group.packet_size;
+		if (job->jobs & BATCH_CHECK) {
+			rv = check_blocks_batch(&group,recording);
+		}
+	} else {
+		if (open_file_f(recording->filenames[0],&file) == -1) {
+			return -1;
+		}
+		set_streaming_file_f(&file,1);
+		packet_size = file.packet_size;
+	}
+	if (rv == 1 && (job->jobs & BATCH_INDEX)) {
+		snprintf(path,sizeof(path),"%s/%s.idx",job->index_dir,recording->name);
+		index = fopen(path,"w");
+		if (index == NULL) {
+			fprintf(stderr,
+			  "%s.%s(%d): unable to open index file '%s'\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  path);
+			rv = -1;
+		}
+	}
+	if (rv == 1) {
+		rv = scan_packets_batch(recording,&file,&group,packet_size,index);
+	}
+	if (index != NULL) {
+		fclose(index);
+	}
+	if (recording->is_sg) {
+		close_group_sg(&group);
+	} else {
+		close_file_f(&file);
+	}
+	return rv;
+}
+
+/* Job function for a single recording, see run_recording_batch.
+ */
+void process_recording_batch(void *arg) {
+	BJob_t *job = (BJob_t *)arg;
+	
+	job->recording->status = run_recording_batch(job);
+	pthread_mutex_lock(&print_lock);
+	print_recording_batch("",job->recording);
+	fflush(stdout);
+	pthread_mutex_unlock(&print_lock);
+}
+
+//////////////////////////////////////////////////////////////// MANIFEST
+
+int open_manifest_batch(const char *filename, BManifest_t *manifest) {
+	size_t len;
+	char line[PATH_MAX];
+	FILE *fp;
+	BRecording_t *recording;
+	
+	memset(manifest,0,sizeof(BManifest_t));
+	fp = fopen(filename,"r");
+	if (fp == NULL) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to open manifest '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  filename);
+		return -1;
+	}
+	while (fgets(line,sizeof(line),fp) != NULL) {
+		// strip trailing whitespace, skip empty lines and comments
+		len = strlen(line);
+		while (len > 0 && (line[len-1] == '\n' || line[len-1] == '\r' ||
+		  line[len-1] == ' ' || line[len-1] == '\t')) {
+			line[--len] = '\0';
+		}
+		if (len == 0 || line[0] == '#') {
+			continue;
+		}
+		recording = find_recording_batch(manifest,line);
+		if (recording == NULL || add_file_batch(recording,line) == -1) {
+			fprintf(stderr,
+			  "%s.%s(%d): unable to add '%s' to manifest\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  line);
+			fclose(fp);
+			close_manifest_batch(manifest);
+			return -1;
+		}
+	}
+	fclose(fp);
+	return 1;
+}
+
+void close_manifest_batch(BManifest_t *manifest) {
+	int ii, jj;
+	BRecording_t *recording;
+	
+	for (ii=0; ii<manifest->recording_count; ii++) {
+		recording = &manifest->recordings[ii];
+		for (jj=0; jj<recording->file_count; jj++) {
+			free(recording->filenames[jj]);
+		}
+		free(recording->filenames);
+		free(recording->name);
+	}
+	if (manifest->recordings != NULL) {
+		free(manifest->recordings);
+		manifest->recordings = NULL;
+	}
+	manifest->recording_count = 0;
+	manifest->recording_capacity = 0;
+}
+
+int run_manifest_batch(BManifest_t *manifest, int jobs, const char *index_dir, int thread_count, int device_limit) {
+	int ii, jj, kk;
+	int device_count;
+	int failed = 0;
+	dev_t device;
+	dev_t devices[WORKPOOL_MAX_JOB_DEVICES];
+	BJob_t *job_args;
+	BRecording_t *recording;
+	WorkPool_t pool;
+	
+	job_args = (BJob_t *)malloc(manifest->recording_count*sizeof(BJob_t));
+	if (job_args == NULL) {
+		return -1;
+	}
+	if (workpool_init(&pool,thread_count,device_limit) == -1) {
+		free(job_args);
+		return -1;
+	}
+	for (ii=0; ii<manifest->recording_count; ii++) {
+		recording = &manifest->recordings[ii];
+		job_args[ii].recording = recording;
+		job_args[ii].jobs = jobs;
+		job_args[ii].index_dir = index_dir;
+		// list distinct devices that hold the files of the recording
+		device_count = 0;
+		for (jj=0; jj<recording->file_count; jj++) {
+			device = workpool_device(recording->filenames[jj]);
+			for (kk=0; kk<device_count; kk++) {
+				if (devices[kk] == device) {
+					break;
+				}
+			}
+			if (kk == device_count && device_count < WORKPOOL_MAX_JOB_DEVICES) {
+				devices[device_count++] = device;
+			}
+		}
+		if (workpool_submit(&pool,process_recording_batch,&job_args[ii],device_count,devices) == -1) {
+			recording->status = -1;
+		}
+	}
+	workpool_destroy(&pool);
+	free(job_args);
+	for (ii=0; ii<manifest->recording_count; ii++) {
+		if (manifest->recordings[ii].status != 1) {
+			failed++;
+		}
+	}
+	return failed;
+}
+
+void print_recording_batch(const char *ldr, const BRecording_t *recording) {
+	fprintf(stdout,
+	  "%s{name: '%s', type: '%s', files: %d, status: %d, packets: %lld, invalid: %lld, "
+	  "bad_frame_length: %lld, time_reversals: %lld, missing_blocks: %lld, duplicate_blocks: %lld, "
+	  "secs: %u..%u, threads: %d}\n",
+	  ldr,recording->name,recording->is_sg ? "sg" : "flat",recording->file_count,recording->status,
+	  (long long)recording->packets,(long long)recording->invalid_packets,
+	  (long long)recording->bad_frame_lengths,(long long)recording->time_reversals,
+	  (long long)recording->missing_blocks,(long long)recording->duplicate_blocks,
+	  recording->first_secs,recording->last_secs,recording->thread_count);
+}
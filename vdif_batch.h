@@ -0,0 +1,99 @@
+#ifndef VDIF_BATCH_H
+#define VDIF_BATCH_H
+
+#include <stdint.h>
+
+/* Jobs that can be run on each recording, combine with bitwise or. All
+ * requested jobs are done in a single pass over the recording, which
+ * always collects statistics (packet count, time range, thread count)
+ * and packet-level integrity counters.
+ *  BATCH_CHECK -- also check scatter-gather groups for missing and
+ *                 duplicate block numbers
+ *  BATCH_INDEX -- write an index file that lists, for every second, the
+ *                 index of the first packet in that second
+ */
+#define BATCH_CHECK 0x01
+#define BATCH_INDEX 0x02
+
+/* Number of packets read per call while scanning a recording.
+ */
+#define BATCH_READ_PACKETS 4096
+
+/* Encapsulates a recording, either a flat file or a scatter-gather
+ * group, and the results of the jobs run on it.
+ */
+typedef struct BRecording {
+	// scan name, the file name without directory and extension
+	char *name;
+	// 1 if scatter-gather group, 0 if flat file
+	int is_sg;
+	// files that comprise the recording
+	char **filenames;
+	// number of files in recording
+	int file_count;
+	// allocated size of filenames
+	int file_capacity;
+	// 1 if all jobs completed, -1 if recording could not be read
+	int status;
+	// number of packets read
+	int64_t packets;
+	// number of packets marked invalid
+	int64_t invalid_packets;
+	// number of packets with frame length different from the stream packet
+	// size
+	int64_t bad_frame_lengths;
+	// number of packets earlier than the preceding packet
+	int64_t time_reversals;
+	// number of block numbers missing from scatter-gather sequence
+	int64_t missing_blocks;
+	// number of block numbers repeated in scatter-gather sequence
+	int64_t duplicate_blocks;
+	// seconds-since-epoch of first and last packet
+	uint32_t first_secs;
+	uint32_t last_secs;
+	// number of distinct thread identifiers
+	int thread_count;
+} BRecording_t;
+
+/* Encapsulates a manifest, the list of recordings to process.
+ */
+typedef struct BManifest {
+	// recordings in order of first appearance in manifest
+	BRecording_t *recordings;
+	// number of recordings
+	int recording_count;
+	// allocated size of recordings
+	int recording_capacity;
+} BManifest_t;
+
+/* Open a manifest file, which lists one file path per line. Empty lines
+ * and lines starting with '#' are ignored. Scatter-gather files with the
+ * same scan name are grouped into a single recording, every flat file is
+ * a recording of its own.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int open_manifest_batch(const char *filename, BManifest_t *manifest);
+
+/* Close a manifest. All dynamically allocated memory associated with the
+ * BManifest_t struct is freed.
+ */
+void close_manifest_batch(BManifest_t *manifest);
+
+/* Run the requested jobs on all recordings in the manifest, using a
+ * work-stealing pool of thread_count threads that allows at most
+ * device_limit recordings to be read concurrently from each device (0
+ * for no limit). Index files are written to index_dir, which is only
+ * used if BATCH_INDEX is requested. Results are stored in the
+ * recordings and printed to stdout as each recording completes.
+ * 
+ * Returns number of recordings that failed, or -1 when an error occurs.
+ */
+int run_manifest_batch(BManifest_t *manifest, int jobs, const char *index_dir, int thread_count, int device_limit);
+
+/* Print string representation of BRecording_t struct to stdout, with
+ * the given lead string at the start of each line.
+ */
+void print_recording_batch(const char *ldr, const BRecording_t *recording);
+
+#endif // VDIF_BATCH_H
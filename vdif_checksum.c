@@ -0,0 +1,434 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "ioutils.h"
+#include "memutils.h"
+#include "vdif_checksum.h"
+#include "vdif_files.h"
+#include "workpool.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+// number of bytes read per call while computing checksums
+#define CHECKSUM_READ_SIZE (4*1024*1024)
+
+// header line written at the start of each sidecar
+#define CHECKSUM_SIDECAR_MAGIC "# vdiftools crc32c"
+
+/* Arguments passed to the job for a single file.
+ */
+typedef struct CSJob {
+	const char *filename;
+	// 1 to verify against sidecar, 0 to generate sidecar
+	int verify;
+	// 1 on success, 0 on verification failure, -1 on error
+	int result;
+} CSJob_t;
+
+// serializes output of parallel jobs
+static pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Initialize an empty CSFile_t struct for the named file.
+ */
+void init_file_cs(const char *filename, CSFile_t *csfile) {
+	memset(csfile,0,sizeof(CSFile_t));
+	csfile->filename = (char *)malloc(strlen(filename) + 1);
+	strcpy(csfile->filename,filename);
+	csfile->status = -1;
+}
+
+/* Append a range to the list.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int add_range_cs(CSFile_t *csfile, off_t offset, int64_t length, int block_num, uint32_t crc) {
+	CSRange_t *tmp;
+	
+	if (csfile->range_count == csfile->range_capacity) {
+		csfile->range_capacity = csfile->range_capacity > 0 ? 2*csfile->range_capacity : 1024;
+		tmp = (CSRange_t *)realloc(csfile->ranges,csfile->range_capacity*sizeof(CSRange_t));
+		if (tmp == NULL) {
+			return -1;
+		}
+		csfile->ranges = tmp;
+	}
+	tmp = &csfile->ranges[csfile->range_count++];
+	tmp->offset = offset;
+	tmp->length = length;
+	tmp->block_num = block_num;
+	tmp->crc = crc;
+	return 1;
+}
+
+/* Lay out ranges of a scatter-gather file: file header, each block, and
+ * any trailing bytes. Blocks are walked in file order. If a block header
+ * has an invalid size, the rest of the file from that header on becomes
+ * a single range, so that it is still covered.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int layout_sg_cs(CSFile_t *csfile) {
+	int64_t length;
+	off_t covered;
+	const char *filenames[1];
+	SGGroup_t group;
+	SGFile_t *sgfile;
+	sgb_header_t sgb_hdr;
+	
+	filenames[0] = csfile->filename;
+	if (open_group_sg(1,filenames,&group) == -1) {
+		return -1;
+	}
+	sgfile = &group.files[0];
+	covered = sizeof(sgf_header_t);
+	if (add_range_cs(csfile,0,covered,CHECKSUM_NO_BLOCK,0) == -1) {
+		close_group_sg(&group);
+		return -1;
+	}
+	while (pread(sgfile->fd,(void *)&sgb_hdr,sizeof(sgb_header_t),covered) == sizeof(sgb_header_t)) {
+		if (sgb_hdr.block_size <= (int)sizeof(sgb_header_t) || sgb_hdr.block_size > sgfile->header.block_size) {
+			fprintf(stderr,
+			  "%s.%s(%d): invalid block size %d at offset %lld in '%s', rest of file is one range\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  sgb_hdr.block_size,(long long)covered,csfile->filename);
+			break;
+		}
+		length = sgb_hdr.block_size;
+		if (covered + length > csfile->size) {
+			length = csfile->size - covered;
+		}
+		if (add_range_cs(csfile,covered,length,sgb_hdr.block_num,0) == -1) {
+			close_group_sg(&group);
+			return -1;
+		}
+		covered += length;
+	}
+	close_group_sg(&group);
+	if (covered < csfile->size) {
+		return add_range_cs(csfile,covered,csfile->size - covered,CHECKSUM_NO_BLOCK,0);
+	}
+	return 1;
+}
+
+/* Lay out ranges of a flat file, CHECKSUM_FLAT_PACKETS packets each.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int layout_flat_cs(CSFile_t *csfile) {
+	int64_t length;
+	off_t offset;
+	FFile_t file;
+	
+	if (open_file_f(csfile->filename,&file) == -1) {
+		return -1;
+	}
+	length = (int64_t)CHECKSUM_FLAT_PACKETS*file.packet_size;
+	close_file_f(&file);
+	for (offset=0; offset<csfile->size; offset+=length) {
+		if (add_range_cs(csfile,offset,offset + length > csfile->size ? csfile->size - offset : length,
+		  CHECKSUM_NO_BLOCK,0) == -1) {
+			return -1;
+		}
+	}
+	return 1;
+}
+
+/* Compute the checksum of every range. If verify is set, compare with
+ * the stored value and report mismatches, otherwise store the computed
+ * value.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int checksum_ranges_cs(CSFile_t *csfile, int verify) {
+	int fd;
+	int rv = 1;
+	int64_t ii;
+	int64_t done;
+	ssize_t bytes;
+	size_t chunk;
+	uint32_t crc;
+	void *buf;
+	CSRange_t *range;
+	IOStream_t stream;
+	
+	fd = open(csfile->filename,O_RDONLY);
+	if (fd == -1) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to open '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  csfile->filename);
+		return -1;
+	}
+	buf = memutils_alloc(CHECKSUM_READ_SIZE);
+	if (buf == NULL) {
+		close(fd);
+		return -1;
+	}
+	// each file is read exactly once, keep the page cache clean
+	ioutils_stream_init(fd,&stream,0);
+	for (ii=0; ii<csfile->range_count && rv == 1; ii++) {
+		range = &csfile->ranges[ii];
+		crc = 0;
+		done = 0;
+		while (done < range->length) {
+			chunk = range->length - done > CHECKSUM_READ_SIZE ? CHECKSUM_READ_SIZE : range->length - done;
+			bytes = pread(fd,buf,chunk,range->offset + done);
+			if (bytes < 0 && errno == EINTR) {
+				continue;
+			}
+			if (bytes < 0) {
+				perror("vdif_checksum.c.checksum_ranges_cs(): ");
+				rv = -1;
+				break;
+			}
+			if (bytes == 0) {
+				// file truncated
+				break;
+			}
+			crc = crc32c(crc,buf,bytes);
+			done += bytes;
+			ioutils_stream_advance(fd,&stream,range->offset + done);
+		}
+		if (rv == -1) {
+			break;
+		}
+		if (!verify) {
+			range->crc = crc;
+			range->length = done;
+		} else if (done < range->length || crc != range->crc) {
+			csfile->bad_ranges++;
+			pthread_mutex_lock(&print_lock);
+			fprintf(stdout,
+			  "%s: block %d at offset %lld (%lld bytes) %s, expected %08x, computed %08x\n",
+			  csfile->filename,range->block_num,(long long)range->offset,(long long)range->length,
+			  done < range->length ? "truncated" : "corrupted",range->crc,crc);
+			pthread_mutex_unlock(&print_lock);
+		}
+	}
+	ioutils_stream_close(fd,&stream,csfile->size);
+	memutils_free(buf);
+	close(fd);
+	return rv;
+}
+
+/* Job function for a single file.
+ */
+void process_file_cs(void *arg) {
+	CSJob_t *job = (CSJob_t *)arg;
+	CSFile_t csfile;
+	
+	if (job->verify) {
+		job->result = read_sidecar_cs(job->filename,&csfile);
+		if (job->result == 1) {
+			job->result = verify_file_cs(&csfile);
+		}
+	} else {
+		job->result = compute_file_cs(job->filename,&csfile);
+		if (job->result == 1) {
+			job->result = write_sidecar_cs(&csfile);
+		}
+	}
+	pthread_mutex_lock(&print_lock);
+	fprintf(stdout,"%s: %s\n",job->filename,
+	  job->result == 1 ? "OK" : (job->result == 0 ? "FAILED" : "ERROR"));
+	fflush(stdout);
+	pthread_mutex_unlock(&print_lock);
+	free_file_cs(&csfile);
+}
+
+/* Run jobs for all files on a work pool.
+ * 
+ * Returns number of files that failed, or -1 when an error occurs.
+ */
+int run_files_cs(int num_files, const char *filenames[], int verify, int thread_count, int device_limit) {
+	int ii;
+	int failed = 0;
+	dev_t device;
+	CSJob_t *jobs;
+	WorkPool_t pool;
+	
+	jobs = (CSJob_t *)malloc(num_files*sizeof(CSJob_t));
+	if (jobs == NULL) {
+		return -1;
+	}
+	if (workpool_init(&pool,thread_count,device_limit) == -1) {
+		free(jobs);
+		return -1;
+	}
+	for (ii=0; ii<num_files; ii++) {
+		jobs[ii].filename = filenames[ii];
+		jobs[ii].verify = verify;
+		jobs[ii].result = -1;
+		device = workpool_device(filenames[ii]);
+		workpool_submit(&pool,process_file_cs,&jobs[ii],1,&device);
+	}
+	workpool_destroy(&pool);
+	for (ii=0; ii<num_files; ii++) {
+		if (jobs[ii].result != 1) {
+			failed++;
+		}
+	}
+	free(jobs);
+	return failed;
+}
+
+//////////////////////////////////////////////////////////////// CHECKSUMS
+
+int compute_file_cs(const char *filename, CSFile_t *csfile) {
+	struct stat st;
+	
+	init_file_cs(filename,csfile);
+	if (stat(filename,&st) == -1) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to stat '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  filename);
+		return -1;
+	}
+	csfile->size = st.st_size;
+	csfile->is_sg = is_file_sg(filename);
+	if (csfile->is_sg) {
+		if (layout_sg_cs(csfile) == -1) {
+			return -1;
+		}
+	} else {
+		if (layout_flat_cs(csfile) == -1) {
+			return -1;
+		}
+	}
+	if (checksum_ranges_cs(csfile,0) == -1) {
+		return -1;
+	}
+	csfile->status = 1;
+	return 1;
+}
+
+int write_sidecar_cs(const CSFile_t *csfile) {
+	int64_t ii;
+	char path[PATH_MAX];
+	FILE *fp;
+	CSRange_t *range;
+	
+	snprintf(path,sizeof(path),"%s%s",csfile->filename,CHECKSUM_SUFFIX);
+	fp = fopen(path,"w");
+	if (fp == NULL) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to open sidecar '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  path);
+		return -1;
+	}
+	fprintf(fp,"%s %s %lld\n",CHECKSUM_SIDECAR_MAGIC,csfile->is_sg ? "sg" : "flat",(long long)csfile->size);
+	for (ii=0; ii<csfile->range_count; ii++) {
+		range = &csfile->ranges[ii];
+		fprintf(fp,"%lld %lld %d %08x\n",
+		  (long long)range->offset,(long long)range->length,range->block_num,range->crc);
+	}
+	if (fclose(fp) != 0) {
+		fprintf(stderr,
+		  "%s.%s(%d): error writing sidecar '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  path);
+		return -1;
+	}
+	return 1;
+}
+
+int read_sidecar_cs(const char *filename, CSFile_t *csfile) {
+	int block_num;
+	long long offset, length, size;
+	unsigned int crc;
+	char path[PATH_MAX];
+	char type[8];
+	FILE *fp;
+	
+	init_file_cs(filename,csfile);
+	snprintf(path,sizeof(path),"%s%s",filename,CHECKSUM_SUFFIX);
+	fp = fopen(path,"r");
+	if (fp == NULL) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to open sidecar '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  path);
+		return -1;
+	}
+	if (fscanf(fp,CHECKSUM_SIDECAR_MAGIC " %7s %lld",type,&size) != 2) {
+		fprintf(stderr,
+		  "%s.%s(%d): invalid sidecar header in '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  path);
+		fclose(fp);
+		return -1;
+	}
+	csfile->is_sg = strcmp(type,"sg") == 0;
+	csfile->size = size;
+	while (fscanf(fp,"%lld %lld %d %x",&offset,&length,&block_num,&crc) == 4) {
+		if (add_range_cs(csfile,offset,length,block_num,crc) == -1) {
+			fclose(fp);
+			return -1;
+		}
+	}
+	if (!feof(fp)) {
+		fprintf(stderr,
+		  "%s.%s(%d): invalid checksum line in '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  path);
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	csfile->status = 1;
+	return 1;
+}
+
+int verify_file_cs(CSFile_t *csfile) {
+	struct stat st;
+	
+	if (stat(csfile->filename,&st) == -1) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to stat '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  csfile->filename);
+		return -1;
+	}
+	if (st.st_size != csfile->size) {
+		pthread_mutex_lock(&print_lock);
+		fprintf(stdout,"%s: size is %lld, expected %lld\n",
+		  csfile->filename,(long long)st.st_size,(long long)csfile->size);
+		pthread_mutex_unlock(&print_lock);
+	}
+	csfile->bad_ranges = 0;
+	if (checksum_ranges_cs(csfile,1) == -1) {
+		return -1;
+	}
+	return (csfile->bad_ranges == 0 && st.st_size == csfile->size) ? 1 : 0;
+}
+
+void free_file_cs(CSFile_t *csfile) {
+	if (csfile->filename != NULL) {
+		free(csfile->filename);
+		csfile->filename = NULL;
+	}
+	if (csfile->ranges != NULL) {
+		free(csfile->ranges);
+		csfile->ranges = NULL;
+	}
+	csfile->range_count = 0;
+	csfile->range_capacity = 0;
+}
+
+int generate_files_cs(int num_files, const char *filenames[], int thread_count, int device_limit) {
+	return run_files_cs(num_files,filenames,0,thread_count,device_limit);
+}
+
+int verify_files_cs(int num_files, const char *filenames[], int thread_count, int device_limit) {
+	return run_files_cs(num_files,filenames,1,thread_count,device_limit);
+}
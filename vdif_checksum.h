@@ -0,0 +1,111 @@
+#ifndef VDIF_CHECKSUM_H
+#define VDIF_CHECKSUM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Suffix appended to a file name to get the name of its checksum
+ * sidecar file.
+ */
+#define CHECKSUM_SUFFIX ".crc"
+
+/* Number of packets covered by each checksum in a flat file.
+ */
+#define CHECKSUM_FLAT_PACKETS 1024
+
+/* Block number recorded for ranges that are not a scatter-gather block,
+ * i.e. the scatter-gather file header, flat file packet ranges, and any
+ * trailing bytes after the last complete block.
+ */
+#define CHECKSUM_NO_BLOCK -1
+
+/* Encapsulates the checksum of a byte range in a file.
+ */
+typedef struct CSRange {
+	// byte offset of range in file
+	off_t offset;
+	// number of bytes in range
+	int64_t length;
+	// scatter-gather block number, or CHECKSUM_NO_BLOCK
+	int block_num;
+	// CRC32C of range
+	uint32_t crc;
+} CSRange_t;
+
+/* Encapsulates the checksums of a file, as computed from the file or
+ * read from its sidecar.
+ */
+typedef struct CSFile {
+	// filename of checked file (not the sidecar)
+	char *filename;
+	// 1 if scatter-gather file, 0 if flat file
+	int is_sg;
+	// file size in bytes
+	off_t size;
+	// list of ranges, in file order
+	CSRange_t *ranges;
+	// number of ranges, and allocated size
+	int64_t range_count;
+	int64_t range_capacity;
+	// number of ranges that failed verification
+	int64_t bad_ranges;
+	// 1 on success, -1 if file or sidecar could not be read
+	int status;
+} CSFile_t;
+
+/* Compute checksums for a file. Scatter-gather files get one checksum
+ * per block (block header and packets), plus one for the file header.
+ * Flat files get one checksum per CHECKSUM_FLAT_PACKETS packets. The
+ * referenced CSFile_t struct is initialized and should be freed with
+ * free_file_cs after use.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int compute_file_cs(const char *filename, CSFile_t *csfile);
+
+/* Write checksums to the sidecar file, which is named after the checked
+ * file with CHECKSUM_SUFFIX appended.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int write_sidecar_cs(const CSFile_t *csfile);
+
+/* Read checksums from the sidecar of the named file. The referenced
+ * CSFile_t struct is initialized and should be freed with free_file_cs
+ * after use.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int read_sidecar_cs(const char *filename, CSFile_t *csfile);
+
+/* Recompute the checksum of every range listed in csfile and compare it
+ * to the stored value. Each mismatch is reported on stdout and counted
+ * in bad_ranges.
+ * 
+ * Returns 1 if all ranges match, 0 if any range does not match, and -1
+ * when an error occurs.
+ */
+int verify_file_cs(CSFile_t *csfile);
+
+/* Free all dynamically allocated memory associated with the CSFile_t
+ * struct.
+ */
+void free_file_cs(CSFile_t *csfile);
+
+/* Compute checksums and write sidecars for all files, in parallel on
+ * thread_count threads with at most device_limit files read
+ * concurrently from each device (0 for no limit).
+ * 
+ * Returns number of files that failed, or -1 when an error occurs.
+ */
+int generate_files_cs(int num_files, const char *filenames[], int thread_count, int device_limit);
+
+/* Verify all files against their sidecars, in parallel as for
+ * generate_files_cs.
+ * 
+ * Returns number of files that failed verification or could not be
+ * checked, or -1 when an error occurs.
+ */
+int verify_files_cs(int num_files, const char *filenames[], int thread_count, int device_limit);
+
+#endif // VDIF_CHECKSUM_H
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ioutils.h"
+#include "vdif_extract.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+/* Read seconds-since-epoch from the header of the packet at the given
+ * byte offset.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+static int read_secs_at(int fd, off_t offset, uint32_t *secs) {
+	vdif_header_t hdr;
+	
+	if (pread(fd,(void *)&hdr,sizeof(vdif_header_t),offset) != sizeof(vdif_header_t)) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to read packet header at offset %lld\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  (long long)offset);
+		return -1;
+	}
+	*secs = hdr.secs_since_epoch;
+	return 1;
+}
+
+/* Find the index of the first packet in a contiguous run of packets
+ * that has a time not earlier than secs.
+ * 
+ * Returns the index (equal to count if no such packet), or -1 on
+ * failure.
+ */
+static int64_t lower_bound_packets(int fd, off_t offset, int packet_size, int64_t count, uint32_t secs) {
+	int64_t lo = 0, hi = count, mid;
+	uint32_t mid_secs;
+	
+	while (lo < hi) {
+		mid = lo + (hi - lo)/2;
+		if (read_secs_at(fd,offset + mid*packet_size,&mid_secs) == -1) {
+			return -1;
+		}
+		if (mid_secs < secs) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+/* Copy a contiguous run of packets to fd_out.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+static int copy_packets(int fd, off_t offset, int packet_size, int64_t count, int fd_out) {
+	size_t len;
+	
+	if (count <= 0) {
+		return 1;
+	}
+	if (ioutils_copy(fd,offset,fd_out,(size_t)count*packet_size,&len) != 1) {
+		fprintf(stderr,
+		  "%s.%s(%d): failed to copy %lld packets at offset %lld (copied %zu bytes)\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  (long long)count,(long long)offset,len);
+		return -1;
+	}
+	return 1;
+}
+
+/* Find the first block in the sorted list whose last packet has a time
+ * not earlier than secs, and the index of the first packet in that
+ * block that has a time not earlier than secs.
+ * 
+ * Returns 1 on success, -1 on failure. If no such block exists, *block
+ * is set to count and *packet to 0.
+ */
+static int lower_bound_blocks(SGBlockLoc_t *locs, int64_t count, int packet_size, uint32_t secs, int64_t *block, int64_t *packet) {
+	int64_t lo = 0, hi = count, mid;
+	uint32_t mid_secs;
+	SGBlockLoc_t *loc;
+	
+	while (lo < hi) {
+		mid = lo + (hi - lo)/2;
+		loc = &locs[mid];
+		if (loc->packet_count == 0) {
+			// empty blocks sort with the preceding block
+			mid_secs = 0;
+		} else if (read_secs_at(loc->fd,loc->offset + (loc->packet_count-1)*packet_size,&mid_secs) == -1) {
+			return -1;
+		}
+		if (mid_secs < secs) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*block = lo;
+	*packet = 0;
+	if (lo < count) {
+		loc = &locs[lo];
+		*packet = lower_bound_packets(loc->fd,loc->offset,packet_size,loc->packet_count,secs);
+		if (*packet == -1) {
+			return -1;
+		}
+	}
+	return 1;
+}
+
+/////////////////////////////////////////////////// SCATTER-GATHER FILES
+
+int64_t extract_range_group_sg(SGGroup_t *sggroup, uint32_t start_secs, uint32_t end_secs, int fd_out) {
+	int packet_size;
+	int64_t ii;
+	int64_t block_count;
+	int64_t first_block, first_packet;
+	int64_t last_block, last_packet;
+	int64_t from, to;
+	int64_t packets_written = 0;
+	SGBlockLoc_t *locs;
+	
+	packet_size = sggroup->packet_size;
+	block_count = index_blocks_group_sg(sggroup,&locs);
+	if (block_count == -1) {
+		fprintf(stderr,
+		  "%s.%s(%d): failed to index scatter-gather blocks\n",
+		  __FILE__,__FUNCTION__,__LINE__);
+		return -1;
+	}
+	if (lower_bound_blocks(locs,block_count,packet_size,start_secs,&first_block,&first_packet) == -1 ||
+	  lower_bound_blocks(locs,block_count,packet_size,end_secs,&last_block,&last_packet) == -1) {
+		free(locs);
+		return -1;
+	}
+	// copy whole blocks in between boundaries, partial boundary blocks
+	for (ii=first_block; ii<=last_block && ii<block_count; ii++) {
+		from = (ii == first_block) ? first_packet : 0;
+		to = (ii == last_block) ? last_packet : locs[ii].packet_count;
+		if (copy_packets(locs[ii].fd,locs[ii].offset + from*packet_size,packet_size,to-from,fd_out) == -1) {
+			free(locs);
+			return -1;
+		}
+		if (to > from) {
+			packets_written += to - from;
+		}
+	}
+	free(locs);
+	return packets_written;
+}
+
+///////////////////////////////////////////////////////////// FLAT FILES
+
+int64_t extract_range_file_f(FFile_t *ffile, uint32_t start_secs, uint32_t end_secs, int fd_out) {
+	int64_t count;
+	int64_t first, last;
+	struct stat st;
+	
+	if (fstat(ffile->fd,&st) == -1) {
+		perror("vdif_extract.c.extract_range_file_f(): ");
+		return -1;
+	}
+	count = st.st_size / ffile->packet_size;
+	first = lower_bound_packets(ffile->fd,0,ffile->packet_size,count,start_secs);
+	last = lower_bound_packets(ffile->fd,0,ffile->packet_size,count,end_secs);
+	if (first == -1 || last == -1) {
+		return -1;
+	}
+	if (last <= first) {
+		return 0;
+	}
+	if (copy_packets(ffile->fd,first*ffile->packet_size,ffile->packet_size,last-first,fd_out) == -1) {
+		return -1;
+	}
+	return last - first;
+}
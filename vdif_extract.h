@@ -0,0 +1,34 @@
+#ifndef VDIF_EXTRACT_H
+#define VDIF_EXTRACT_H
+
+#include <stdint.h>
+#include "vdif_files.h"
+
+/* Copy all packets with VDIF time in the range [start_secs, end_secs)
+ * from a flat file to the current position in the file described by
+ * fd_out. The flat file should be open, its index and file offset are
+ * not changed by the extraction.
+ * 
+ * Returns number of packets written, and -1 when an error occurs.
+ * 
+ * Range boundaries are located by binary search on packet headers, so
+ * packets are assumed to be approximately time-ordered. Data is moved
+ * inside the kernel where possible (see ioutils_copy).
+ */
+int64_t extract_range_file_f(FFile_t *ffile, uint32_t start_secs, uint32_t end_secs, int fd_out);
+
+/* Copy all packets with VDIF time in the range [start_secs, end_secs)
+ * from a scatter-gather group to the current position in the file
+ * described by fd_out. Blocks are gathered in block_num order, so the
+ * output is a flat VDIF file. The scatter-gather group should be open,
+ * its block indecies and file offsets are not changed by the extraction.
+ * 
+ * Returns number of packets written, and -1 when an error occurs.
+ * 
+ * Range boundaries are located by binary search on the last packet
+ * header in each block, and then on packet headers within the boundary
+ * blocks.
+ */
+int64_t extract_range_group_sg(SGGroup_t *sggroup, uint32_t start_secs, uint32_t end_secs, int fd_out);
+
+#endif // VDIF_EXTRACT_H
@@ -7,6 +7,7 @@
 #include <unistd.h>
 
 #include "ioutils.h"
+#include "memutils.h"
 #include "vdif_files.h"
 
 /////////////////////////////////////////////////// INTERNAL DEFINITIONS
@@ -36,6 +37,8 @@ int open_file_sg(const char *filename, SGFile_t *sgfile) {
 	len = strlen(filename) + 1; // plus one for trailing '\0'
 	sgfile->filename = (char *)malloc(len);
 	strcpy(sgfile->filename,filename);
+	// streaming mode is off by default
+	sgfile->stream.enabled = 0;
 	// open file and store descriptor
 	sgfile->fd = open(filename,O_RDONLY);
 	if (sgfile->fd == -1) {
@@ -70,7 +73,7 @@ int open_file_sg(const char *filename, SGFile_t *sgfile) {
 		  filename);
 		return -1;
 	}
-	if (len == 0) {
+	if (len < sizeof(sgb_header_t)) {
 		sgfile->next_block_num = -1;
 		sgfile->next_block_size = -1;
 	} else {
@@ -83,6 +86,10 @@ int open_file_sg(const char *filename, SGFile_t *sgfile) {
 /* Close scatter-gather file.
  */
 void close_file_sg(SGFile_t *sgfile) {
+	// leave streaming mode
+	if (sgfile->stream.enabled) {
+		ioutils_stream_close(sgfile->fd,&sgfile->stream,lseek(sgfile->fd,0,SEEK_CUR));
+	}
 	// reset parameters
 	sgfile->index = -1;
 	sgfile->next_block_num = -1;
@@ -126,23 +133,121 @@ int compare_files_sg(const void *a, const void *b) {
 	}
 }
 
+/* Take a buffer of at least size bytes from the pool, allocating or
+ * growing one if needed. The allocated size is stored in *data_size.
+ * 
+ * Returns pointer to buffer, or NULL on failure.
+ */
+void *acquire_buffer_sg(SGBlockPool_t *pool, size_t size, size_t *data_size) {
+	int ii;
+	void *buf;
+	
+	if (pool->count > 0) {
+		// prefer a buffer that is large enough...
+		for (ii=pool->count-1; ii>0; ii--) {
+			if (pool->sizes[ii] >= size) {
+				break;
+			}
+		}
+		buf = pool->buffers[ii];
+		*data_size = pool->sizes[ii];
+		pool->count--;
+		pool->buffers[ii] = pool->buffers[pool->count];
+		pool->sizes[ii] = pool->sizes[pool->count];
+		// ...otherwise grow the one found
+		if (*data_size < size) {
+			memutils_free(buf);
+			buf = memutils_alloc(size);
+			*data_size = size;
+		}
+	} else {
+		buf = memutils_alloc(size);
+		*data_size = size;
+	}
+	if (buf == NULL) {
+		*data_size = 0;
+	}
+	return buf;
+}
+
+/* Return a buffer to the pool. If the pool is full, the buffer is
+ * freed.
+ */
+void release_buffer_sg(SGBlockPool_t *pool, void *buf, size_t data_size) {
+	if (buf == NULL) {
+		return;
+	}
+	if (pool->count < SG_BLOCK_POOL_SIZE) {
+		pool->buffers[pool->count] = buf;
+		pool->sizes[pool->count] = data_size;
+		pool->count++;
+	} else {
+		memutils_free(buf);
+	}
+}
+
+/* Free all buffers held by the pool.
+ */
+void clear_pool_sg(SGBlockPool_t *pool) {
+	int ii;
+	
+	for (ii=0; ii<pool->count; ii++) {
+		memutils_free(pool->buffers[ii]);
+		pool->buffers[ii] = NULL;
+		pool->sizes[ii] = 0;
+	}
+	pool->count = 0;
+}
+
 /* Read the entire next block of data from the file, and store it in
  * the data buffer in the referenced SGBlock_t struct. Buffer memory is
- * allocated and should be freed by a call to destroy_block_sg afterward.
+ * taken from the given pool and should be returned by a call to
+ * destroy_block_sg afterward.
  * 
  * Returns 1 on success, and -1 on failure.
  */
-int read_block_from_file_sg(SGFile_t *sgfile, SGBlock_t *sgblock) {
+int read_block_from_file_sg(SGFile_t *sgfile, SGBlockPool_t *pool, SGBlock_t *sgblock) {
 	size_t len;
+	size_t data_len;
 	sgb_header_t sgb_hdr;
 	
+	if (sgfile->next_block_size > 0 && (sgfile->next_block_size <= (int)sizeof(sgb_header_t) ||
+	  sgfile->next_block_size > sgfile->header.block_size)) {
+		fprintf(stderr,
+		  "%s.%s(%d): invalid block size %d for block %d in '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  sgfile->next_block_size,sgfile->next_block_num,sgfile->filename);
+		return -1;
+	}
 	if (sgfile->next_block_size > 0) {
 		// read block data
+		data_len = sgfile->next_block_size - sizeof(sgb_header_t);
 		sgblock->block_num = sgfile->next_block_num;
 		sgblock->packet_size = sgfile->header.packet_size;
-		sgblock->packet_count = sgfile->next_block_size / sgblock->packet_size;
-		sgblock->data = malloc(sgfile->next_block_size);
-		ioutils_read(sgfile->fd,(void *)sgblock->data,sgfile->next_block_size-sizeof(sgb_header_t),&len);
+		sgblock->packet_count = data_len / sgblock->packet_size;
+		sgblock->data = acquire_buffer_sg(pool,data_len,&sgblock->data_size);
+		if (sgblock->data == NULL) {
+			fprintf(stderr,
+			  "%s.%s(%d): unable to allocate %zu bytes for block from '%s'\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  data_len,sgfile->filename);
+			return -1;
+		}
+		if (ioutils_read(sgfile->fd,(void *)sgblock->data,data_len,&len) == -1) {
+			fprintf(stderr,
+			  "%s.%s(%d): error reading block %d in '%s'\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  sgblock->block_num,sgfile->filename);
+			return -1;
+		}
+		if (len < data_len) {
+			// keep the complete packets of a truncated final block
+			fprintf(stderr,
+			  "%s.%s(%d): block %d in '%s' truncated to %zu of %zu bytes\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  sgblock->block_num,sgfile->filename,len,data_len);
+			sgblock->packet_count = len / sgblock->packet_size;
+		}
 		// get next block number and update sgfile
 		if (ioutils_read(sgfile->fd,(void *)&sgb_hdr,sizeof(sgb_header_t),&len) == -1) {
 			fprintf(stderr,
@@ -152,7 +257,16 @@ int read_block_from_file_sg(SGFile_t *sgfile, SGBlock_t *sgblock) {
 			return -1;
 		}
 		//~ fprintf(stdout,"len = %d\n",(int)len);
-		if (len == 0) {
+		if (sgfile->stream.enabled) {
+			ioutils_stream_advance(sgfile->fd,&sgfile->stream,lseek(sgfile->fd,0,SEEK_CUR));
+		}
+		if (len > 0 && len < sizeof(sgb_header_t)) {
+			fprintf(stderr,
+			  "%s.%s(%d): truncated block header after block %d in '%s'\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  sgblock->block_num,sgfile->filename);
+		}
+		if (len < sizeof(sgb_header_t)) {
 			sgfile->next_block_num = -1;
 			sgfile->next_block_size = -1;
 		} else {
@@ -166,13 +280,15 @@ int read_block_from_file_sg(SGFile_t *sgfile, SGBlock_t *sgblock) {
 		sgblock->packet_size = -1;
 		sgblock->packet_count = 0;
 		sgblock->data = NULL;
+		sgblock->data_size = 0;
 	}
 	return 1;
 }
 
 /* Read the entire next block of data from the group, and store it in
  * the data buffer in the referenced SGBlock_t struct. Buffer memory is
- * allocated and should be freed by a call to destroy_block_sg afterward.
+ * taken from the group buffer pool and should be returned by a call to
+ * destroy_block_sg afterward.
  * 
  * Returns 1 on success, and -1 on failure.
  */
@@ -180,7 +296,7 @@ int read_block_from_group_sg(SGGroup_t *sggroup, SGBlock_t *sgblock) {
 	// sort files according to block number
 	qsort(sggroup->files,sggroup->file_count,sizeof(SGFile_t),compare_files_sg);
 	// read block from first file (after sort)
-	if (read_block_from_file_sg(&sggroup->files[0],sgblock) == -1) {
+	if (read_block_from_file_sg(&sggroup->files[0],&sggroup->pool,sgblock) == -1) {
 		fprintf(stderr,
 		  "%s.%s(%d): unable to read next block from '%s'\n",
 		  __FILE__,__FUNCTION__,__LINE__,
@@ -192,19 +308,28 @@ int read_block_from_group_sg(SGGroup_t *sggroup, SGBlock_t *sgblock) {
 }
 
 /* Call this method when block data is no longer needed. All parameters
- * are reset and the data buffer is freed.
+ * are reset and the data buffer is returned to the pool.
  */
-void destroy_block_sg(SGBlock_t *sgblock) {
+void destroy_block_sg(SGBlockPool_t *pool, SGBlock_t *sgblock) {
 	sgblock->block_num = -1;
 	sgblock->index = -1;
 	sgblock->packet_size = -1;
 	sgblock->packet_count = -1;
 	if (sgblock->data != NULL) {
-		free(sgblock->data);
+		release_buffer_sg(pool,sgblock->data,sgblock->data_size);
 		sgblock->data = NULL;
+		sgblock->data_size = 0;
 	}
 }
 
+/* Compare two SGBlockLoc_t structs on block number, for sorting.
+ */
+int compare_block_locs_sg(const void *a, const void *b) {
+	const SGBlockLoc_t *loc_a = (const SGBlockLoc_t *)a;
+	const SGBlockLoc_t *loc_b = (const SGBlockLoc_t *)b;
+	return (loc_a->block_num > loc_b->block_num) - (loc_a->block_num < loc_b->block_num);
+}
+
 /* Print string representation of SGFile_t struct to stdout, with the
  * given lead string at the start of each line.
  */
@@ -225,12 +350,32 @@ void print_block_sg(const char *ldr, const SGBlock_t *sgblock) {
 
 /////////////////////////////////////////////////// SCATTER-GATHER FILES
 
+int is_file_sg(const char *filename) {
+	int fd;
+	size_t len;
+	sgf_header_t header;
+	
+	fd = open(filename,O_RDONLY);
+	if (fd == -1) {
+		return 0;
+	}
+	if (ioutils_read(fd,(void *)&header,sizeof(sgf_header_t),&len) <= 0) {
+		close(fd);
+		return 0;
+	}
+	close(fd);
+	return is_valid_sgfile_header(&header);
+}
+
 int open_group_sg(int num_files, const char *filenames[], SGGroup_t *sggroup) {
 	int ii;
 	
-	// initialize sub-block parameters
-	sggroup->subblock_packet_count = 0;
-	sggroup->subblock_data = NULL;
+	// initialize buffer pool and current block
+	sggroup->pool.count = 0;
+	sggroup->block.data = NULL;
+	sggroup->block.data_size = 0;
+	sggroup->block.packet_count = 0;
+	sggroup->block_cursor = 0;
 	// initialize the array of SGFile_t objects
 	sggroup->files = (SGFile_t *)malloc(num_files*sizeof(SGFile_t));
 	for (ii=0; ii<num_files; ii++) {
@@ -273,81 +418,127 @@ void close_group_sg(SGGroup_t *sggroup) {
 		free(sggroup->files);
 		sggroup->files = NULL;
 	}
-	if (sggroup->subblock_data != NULL) {
-		free(sggroup->subblock_data);
-		sggroup->subblock_data = NULL;
-	}
+	destroy_block_sg(&sggroup->pool,&sggroup->block);
+	clear_pool_sg(&sggroup->pool);
 	// reset parameters
 	sggroup->file_count = -1;
 	sggroup->packet_size = -1;
-	sggroup->subblock_packet_count = -1;
+	sggroup->block_cursor = -1;
 }
 
 int read_packets_from_group_sg(SGGroup_t *sggroup, int num_packets, void **buf) {
+	*buf = memutils_alloc((size_t)num_packets*sggroup->packet_size);
+	return read_packets_into_group_sg(sggroup,num_packets,*buf);
+}
+
+void free_packets_group_sg(void *buf) {
+	memutils_free(buf);
+}
+
+int read_packets_into_group_sg(SGGroup_t *sggroup, int num_packets, void *buf) {
 	int packet_size;
 	int read_packets;
-	int subblock_read;
-	int subblock_save;
-	SGBlock_t block;
+	int copy_packets;
+	SGBlock_t *block;
 	
 	read_packets = 0;
 	packet_size = sggroup->packet_size;
-	*buf = malloc(num_packets*packet_size);
-	// first copy data from sub-block buffer
-	if (sggroup->subblock_packet_count > 0) {
-		if (num_packets >= sggroup->subblock_packet_count) {
-			// copy all the sub-block data
-			memcpy(*buf,sggroup->subblock_data,
-			  sggroup->subblock_packet_count*packet_size);
-			read_packets += sggroup->subblock_packet_count;
-			// clear sub-block buffer
-			free(sggroup->subblock_data);
-			sggroup->subblock_data = NULL;
-			sggroup->subblock_packet_count = 0;
-		} else {
-			// copy only part of the data
-			memcpy(*buf,sggroup->subblock_data,num_packets*packet_size);
-			read_packets += num_packets;
-			// shift data in sub-block data, and reduce packet count
-			memmove(sggroup->subblock_data,sggroup->subblock_data+num_packets*packet_size,
-			  (sggroup->subblock_packet_count-num_packets)*packet_size);
-			sggroup->subblock_packet_count = sggroup->subblock_packet_count - num_packets;
-		}
-	}
+	block = &sggroup->block;
 	while (read_packets < num_packets) {
-		if (!read_block_from_group_sg(sggroup,&block)) {
-			fprintf(stderr,
-			  "%s.%s(%d): failed to read next block\n",
-			  __FILE__,__FUNCTION__,__LINE__);
-			return -1;
-		}
-		if (block.packet_count == 0) {
-			break;
+		// advance to next block when current one is consumed
+		if (sggroup->block_cursor >= block->packet_count) {
+			destroy_block_sg(&sggroup->pool,block);
+			sggroup->block_cursor = 0;
+			if (read_block_from_group_sg(sggroup,block) == -1) {
+				fprintf(stderr,
+				  "%s.%s(%d): failed to read next block\n",
+				  __FILE__,__FUNCTION__,__LINE__);
+				return -1;
+			}
+			if (block->block_num == -1) {
+				break;
+			}
+			// a truncated block may hold no complete packet
+			if (block->packet_count == 0) {
+				continue;
+			}
 		}
-		if (read_packets + block.packet_count > num_packets) {
-			// count packets to read / save
-			subblock_read = (num_packets-read_packets);
-			subblock_save = block.packet_count-subblock_read;
-			// copy "read" packets
-			memcpy(*buf+read_packets*packet_size,block.data,
-			  subblock_read*packet_size);
-			read_packets += subblock_read;
-			// copy "save" packets
-			sggroup->subblock_packet_count = subblock_save;
-			sggroup->subblock_data = malloc(subblock_save*packet_size);
-			memcpy(sggroup->subblock_data,block.data+(subblock_read)*packet_size,
-			  subblock_save*sggroup->packet_size);
-		} else {
-			// copy all packet from block
-			memcpy(*buf+read_packets*packet_size,block.data,
-			  block.packet_count*packet_size);
-			read_packets += block.packet_count;
+		// copy as many packets as possible from the current block
+		copy_packets = block->packet_count - sggroup->block_cursor;
+		if (copy_packets > num_packets - read_packets) {
+			copy_packets = num_packets - read_packets;
 		}
-		destroy_block_sg(&block);
+		memcpy(buf+read_packets*packet_size,
+		  block->data+sggroup->block_cursor*packet_size,
+		  copy_packets*packet_size);
+		sggroup->block_cursor += copy_packets;
+		read_packets += copy_packets;
 	}
 	return read_packets;
 }
 
+int64_t index_blocks_group_sg(SGGroup_t *sggroup, SGBlockLoc_t **locs) {
+	int ii;
+	int64_t count = 0, capacity = 1024;
+	off_t offset;
+	sgb_header_t sgb_hdr;
+	SGFile_t *sgfile;
+	SGBlockLoc_t *tmp;
+	
+	*locs = (SGBlockLoc_t *)malloc(capacity*sizeof(SGBlockLoc_t));
+	for (ii=0; ii<sggroup->file_count; ii++) {
+		sgfile = &sggroup->files[ii];
+		offset = sizeof(sgf_header_t);
+		while (pread(sgfile->fd,(void *)&sgb_hdr,sizeof(sgb_header_t),offset) == sizeof(sgb_header_t)) {
+			if (sgb_hdr.block_size <= (int)sizeof(sgb_header_t)) {
+				fprintf(stderr,
+				  "%s.%s(%d): invalid block size %d at offset %lld in '%s'\n",
+				  __FILE__,__FUNCTION__,__LINE__,
+				  sgb_hdr.block_size,(long long)offset,sgfile->filename);
+				free(*locs);
+				*locs = NULL;
+				return -1;
+			}
+			if (count == capacity) {
+				capacity *= 2;
+				tmp = (SGBlockLoc_t *)realloc(*locs,capacity*sizeof(SGBlockLoc_t));
+				if (tmp == NULL) {
+					free(*locs);
+					*locs = NULL;
+					return -1;
+				}
+				*locs = tmp;
+			}
+			(*locs)[count].block_num = sgb_hdr.block_num;
+			(*locs)[count].fd = sgfile->fd;
+			(*locs)[count].filename = sgfile->filename;
+			(*locs)[count].offset = offset + sizeof(sgb_header_t);
+			(*locs)[count].block_size = sgb_hdr.block_size;
+			(*locs)[count].packet_count = (sgb_hdr.block_size - sizeof(sgb_header_t)) / sggroup->packet_size;
+			count++;
+			offset += sgb_hdr.block_size;
+		}
+	}
+	qsort(*locs,count,sizeof(SGBlockLoc_t),compare_block_locs_sg);
+	return count;
+}
+
+void set_streaming_group_sg(SGGroup_t *sggroup, int enable) {
+	int ii;
+	SGFile_t *sgfile;
+	off_t offset;
+	
+	for (ii=0; ii<sggroup->file_count; ii++) {
+		sgfile = &sggroup->files[ii];
+		offset = lseek(sgfile->fd,0,SEEK_CUR);
+		if (enable && !sgfile->stream.enabled) {
+			ioutils_stream_init(sgfile->fd,&sgfile->stream,offset);
+		} else if (!enable) {
+			ioutils_stream_close(sgfile->fd,&sgfile->stream,offset);
+		}
+	}
+}
+
 void print_group_sg(const char *ldr, const SGGroup_t *sggroup) {
 	int ii;
 	SGFile_t *sgfile;
@@ -368,6 +559,8 @@ int open_file_f(const char *filename, FFile_t *ffile) {
 	len = strlen(filename) + 1; // plus one for trailing '\0'
 	ffile->filename = (char *)malloc(len);
 	strcpy(ffile->filename,filename);
+	// streaming mode is off by default
+	ffile->stream.enabled = 0;
 	// open file and store descriptor
 	ffile->fd = open(filename,O_RDONLY);
 	if (ffile->fd == -1) {
@@ -404,6 +597,10 @@ int open_file_f(const char *filename, FFile_t *ffile) {
 }
 
 void close_file_f(FFile_t *ffile) {
+	// leave streaming mode
+	if (ffile->stream.enabled) {
+		ioutils_stream_close(ffile->fd,&ffile->stream,lseek(ffile->fd,0,SEEK_CUR));
+	}
 	// reset parameters
 	ffile->index = -1;
 	ffile->packet_size = -1;
@@ -422,17 +619,239 @@ void close_file_f(FFile_t *ffile) {
 }
 
 int read_packets_from_file_f(FFile_t *ffile, int num_packets, void **buf) {
+	*buf = memutils_alloc((size_t)num_packets*ffile->packet_size);
+	return read_packets_into_file_f(ffile,num_packets,*buf);
+}
+
+void free_packets_file_f(void *buf) {
+	memutils_free(buf);
+}
+
+int read_packets_into_file_f(FFile_t *ffile, int num_packets, void *buf) {
 	int packet_size;
 	size_t len;
 	
 	packet_size = ffile->packet_size;
-	*buf = malloc(num_packets*packet_size);
-	if (ioutils_read(ffile->fd,*buf,num_packets*packet_size,&len) == -1) {
+	if (ioutils_read(ffile->fd,buf,num_packets*packet_size,&len) == -1) {
 		fprintf(stderr,
 		  "%s.%s(%d): error reading packets from '%s'\n",
 		  __FILE__,__FUNCTION__,__LINE__,
 		  ffile->filename);
 		return -1;
 	};
+	if (ffile->stream.enabled) {
+		ioutils_stream_advance(ffile->fd,&ffile->stream,lseek(ffile->fd,0,SEEK_CUR));
+	}
 	return len/packet_size;
 }
+
+void set_streaming_file_f(FFile_t *ffile, int enable) {
+	off_t offset;
+	
+	offset = lseek(ffile->fd,0,SEEK_CUR);
+	if (enable && !ffile->stream.enabled) {
+		ioutils_stream_init(ffile->fd,&ffile->stream,offset);
+	} else if (!enable) {
+		ioutils_stream_close(ffile->fd,&ffile->stream,offset);
+	}
+}
+
+////////////////////////////////////////////////// MULTI-FILE FLAT STREAMS
+
+/* Open the file at index in the stream list, check its packet size
+ * against the stream, and apply streaming mode if enabled.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int open_file_stream_f(FStream_t *fstream, int index, FFile_t *ffile) {
+	if (open_file_f(fstream->filenames[index],ffile) == -1) {
+		return -1;
+	}
+	if (ffile->packet_size != fstream->packet_size) {
+		fprintf(stderr,
+		  "%s.%s(%d): flat file '%s' packet size %d does not match FStream_t packet size %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  fstream->filenames[index],ffile->packet_size,fstream->packet_size);
+		close_file_f(ffile);
+		return -1;
+	}
+	if (fstream->streaming) {
+		set_streaming_file_f(ffile,1);
+	}
+	return 1;
+}
+
+/* Open the next file ahead of time once the current one runs low, and
+ * ask the kernel to start reading it.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+int prefetch_next_stream_f(FStream_t *fstream) {
+	off_t offset;
+	
+	if (fstream->next_open || fstream->current_index+1 >= fstream->file_count) {
+		return 1;
+	}
+	offset = lseek(fstream->current.fd,0,SEEK_CUR);
+	if (fstream->current_size - offset > FSTREAM_PREFETCH_BYTES) {
+		return 1;
+	}
+	if (open_file_stream_f(fstream,fstream->current_index+1,&fstream->next) == -1) {
+		return -1;
+	}
+	fstream->next_open = 1;
+	// streaming mode already requested its read-ahead window
+	if (!fstream->streaming) {
+		posix_fadvise(fstream->next.fd,0,FSTREAM_PREFETCH_BYTES,POSIX_FADV_WILLNEED);
+	}
+	return 1;
+}
+
+/* Close the current file and make the next one current.
+ * 
+ * Returns 1 on success, 0 if there is no next file, -1 on failure.
+ */
+int advance_stream_f(FStream_t *fstream) {
+	struct stat st;
+	
+	if (fstream->current_index+1 >= fstream->file_count) {
+		return 0;
+	}
+	close_file_f(&fstream->current);
+	if (!fstream->next_open) {
+		if (open_file_stream_f(fstream,fstream->current_index+1,&fstream->next) == -1) {
+			fstream->current_index = fstream->file_count;
+			return -1;
+		}
+	}
+	fstream->current = fstream->next;
+	fstream->next_open = 0;
+	fstream->current_index++;
+	fstream->current_size = fstat(fstream->current.fd,&st) == -1 ? 0 : st.st_size;
+	return 1;
+}
+
+int open_stream_f(int num_files, const char *filenames[], FStream_t *fstream) {
+	int ii;
+	int fd;
+	size_t len;
+	vdif_header_t hdr;
+	struct stat st;
+	
+	fstream->file_count = 0;
+	fstream->next_open = 0;
+	fstream->streaming = 0;
+	fstream->index = 0;
+	// no file is current until the first one is open
+	fstream->current_index = -1;
+	fstream->filenames = (char **)malloc(num_files*sizeof(char *));
+	// check frame length of all files before reading any data
+	for (ii=0; ii<num_files; ii++) {
+		fstream->filenames[ii] = (char *)malloc(strlen(filenames[ii]) + 1);
+		strcpy(fstream->filenames[ii],filenames[ii]);
+		fstream->file_count++;
+		fd = open(filenames[ii],O_RDONLY);
+		if (fd == -1 || ioutils_read(fd,(void *)&hdr,sizeof(vdif_header_t),&len) <= 0) {
+			fprintf(stderr,
+			  "%s.%s(%d): failed to read vdif header bytes from '%s'\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  filenames[ii]);
+			if (fd != -1) {
+				close(fd);
+			}
+			close_stream_f(fstream);
+			return -1;
+		}
+		close(fd);
+		if (ii == 0) {
+			fstream->packet_size = hdr.frame_length*8;
+		} else if ((int)hdr.frame_length*8 != fstream->packet_size) {
+			fprintf(stderr,
+			  "%s.%s(%d): flat file '%s' packet size %d does not match FStream_t packet size %d\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  filenames[ii],hdr.frame_length*8,fstream->packet_size);
+			close_stream_f(fstream);
+			return -1;
+		}
+	}
+	if (num_files == 0 || open_file_stream_f(fstream,0,&fstream->current) == -1) {
+		close_stream_f(fstream);
+		return -1;
+	}
+	fstream->current_index = 0;
+	fstream->current_size = fstat(fstream->current.fd,&st) == -1 ? 0 : st.st_size;
+	return 1;
+}
+
+void close_stream_f(FStream_t *fstream) {
+	int ii;
+	
+	if (fstream->current_index >= 0 && fstream->current_index < fstream->file_count) {
+		close_file_f(&fstream->current);
+	}
+	if (fstream->next_open) {
+		close_file_f(&fstream->next);
+		fstream->next_open = 0;
+	}
+	if (fstream->filenames != NULL) {
+		for (ii=0; ii<fstream->file_count; ii++) {
+			free(fstream->filenames[ii]);
+		}
+		free(fstream->filenames);
+		fstream->filenames = NULL;
+	}
+	fstream->file_count = -1;
+	fstream->current_index = -1;
+	fstream->packet_size = -1;
+	fstream->index = -1;
+}
+
+int read_packets_from_stream_f(FStream_t *fstream, int num_packets, void **buf) {
+	*buf = memutils_alloc((size_t)num_packets*fstream->packet_size);
+	return read_packets_into_stream_f(fstream,num_packets,*buf);
+}
+
+void free_packets_stream_f(void *buf) {
+	memutils_free(buf);
+}
+
+int read_packets_into_stream_f(FStream_t *fstream, int num_packets, void *buf) {
+	int rv;
+	int read_packets = 0;
+	
+	if (fstream->current_index < 0 || fstream->current_index >= fstream->file_count) {
+		return 0;
+	}
+	while (read_packets < num_packets) {
+		rv = read_packets_into_file_f(&fstream->current,num_packets-read_packets,
+		  buf+read_packets*fstream->packet_size);
+		if (rv == -1) {
+			return -1;
+		}
+		read_packets += rv;
+		if (read_packets < num_packets) {
+			// current file exhausted, continue with next
+			rv = advance_stream_f(fstream);
+			if (rv == -1) {
+				return -1;
+			} else if (rv == 0) {
+				break;
+			}
+		}
+	}
+	if (prefetch_next_stream_f(fstream) == -1) {
+		return -1;
+	}
+	fstream->index += read_packets;
+	return read_packets;
+}
+
+void set_streaming_stream_f(FStream_t *fstream, int enable) {
+	fstream->streaming = enable ? 1 : 0;
+	if (fstream->current_index >= 0 && fstream->current_index < fstream->file_count) {
+		set_streaming_file_f(&fstream->current,enable);
+	}
+	if (fstream->next_open) {
+		set_streaming_file_f(&fstream->next,enable);
+	}
+}
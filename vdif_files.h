@@ -1,7 +1,10 @@
 #ifndef VDIF_FILES_H
 #define VDIF_FILES_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include "ioutils.h"
 #include "vdif_frames.h"
 
 /////////////////////////////////////////////////// SCATTER-GATHER FILES
@@ -48,8 +51,41 @@ typedef struct SGBlock {
 	int packet_count;
 	// buffer filled with block data
 	void *data;
+	// allocated size of data buffer in bytes
+	size_t data_size;
 } SGBlock_t;
 
+/* Location of a single scatter-gather block on disk.
+ */
+typedef struct SGBlockLoc {
+	// raw block number
+	int block_num;
+	// descriptor and name of file that contains the block
+	int fd;
+	const char *filename;
+	// byte offset of first packet in block
+	off_t offset;
+	// raw block size, includes block header
+	int block_size;
+	// number of packets in block
+	int64_t packet_count;
+} SGBlockLoc_t;
+
+/* Pool of block buffers that are reused across block reads, which keeps
+ * the steady-state read loop free of allocations and page faults. The
+ * pool is a free list, not a ring: a buffer is taken for each block read
+ * and put back when the block is consumed.
+ */
+#define SG_BLOCK_POOL_SIZE 4
+typedef struct SGBlockPool {
+	// buffers available for reuse
+	void *buffers[SG_BLOCK_POOL_SIZE];
+	// allocated size in bytes of each available buffer
+	size_t sizes[SG_BLOCK_POOL_SIZE];
+	// number of available buffers
+	int count;
+} SGBlockPool_t;
+
 /* Encapsulates a scatter-gather file, keeps bookkeeping information on
  * status of read data.
  */
@@ -66,6 +102,8 @@ typedef struct SGFile {
 	int next_block_num;
 	// block_size of next block
 	int next_block_size;
+	// streaming mode state
+	IOStream_t stream;
 } SGFile_t;
 
 /* Encapsulates a scatter-gather group of files, keeps collection of
@@ -78,12 +116,22 @@ typedef struct SGGroup {
 	int file_count;
 	// packet size
 	int packet_size;
-	// number of sub-block packets
-	int subblock_packet_count;
-	// sub-block packet data
-	void *subblock_data;
+	// pool of reusable block buffers
+	SGBlockPool_t pool;
+	// block currently being consumed
+	SGBlock_t block;
+	// index of the next packet to consume in the current block, a linear
+	// index that is reset to 0 when the next block is read (not a ring
+	// cursor over the pool buffers)
+	int block_cursor;
 } SGGroup_t;
 
+/* Test if the named file starts with a valid scatter-gather file header.
+ * 
+ * Returns 1 if it does, 0 if it does not or if it cannot be read.
+ */
+int is_file_sg(const char *filename);
+
 /* Open a group of scatter-gather files. The referenced SGGroup_t struct
  * is initialized and should be used in subsequent calls to *_group_sg
  * functions.
@@ -98,9 +146,10 @@ int open_group_sg(int num_files, const char *filenames[], SGGroup_t *sggroup);
 void close_group_sg(SGGroup_t *sggroup);
 
 /* Read a number of packets from scatter-gather group and store them in
- * a buffer. Buffer memory is allocated dynamically and should be freed
- * manually after use. The scatter-gather group should be open, and
- * block indecies are advanced by the read.
+ * a buffer. Buffer memory is allocated with memutils_alloc, under the
+ * current memory policy, and should be released with
+ * free_packets_group_sg (not free) after use. The scatter-gather group
+ * should be open, and block indecies are advanced by the read.
  * 
  * Returns number of packets read (can be less than requested number of
  * packets if end-of-file reached), 0 when no more packets could be
@@ -111,6 +160,35 @@ void close_group_sg(SGGroup_t *sggroup);
  */
 int read_packets_from_group_sg(SGGroup_t *sggroup, int num_packets, void **buf);
 
+/* Release a buffer returned by read_packets_from_group_sg. Does nothing
+ * if buf is NULL.
+ */
+void free_packets_group_sg(void *buf);
+
+/* Read a number of packets from scatter-gather group and store them in
+ * a buffer provided by the caller, which should be large enough to
+ * hold num_packets packets. Otherwise the same as
+ * read_packets_from_group_sg.
+ */
+int read_packets_into_group_sg(SGGroup_t *sggroup, int num_packets, void *buf);
+
+/* Walk the block headers of all files in the group and build a list of
+ * block locations, sorted by block number. Headers are read with pread,
+ * so block indecies and file offsets are not changed. Memory allocated
+ * to *locs should be freed manually after use.
+ * 
+ * Returns number of blocks found, or -1 when an error occurs.
+ */
+int64_t index_blocks_group_sg(SGGroup_t *sggroup, SGBlockLoc_t **locs);
+
+/* Enable (enable != 0) or disable (enable == 0) streaming mode on all
+ * files in a scatter-gather group. In streaming mode data is requested
+ * ahead of the read cursor and dropped from page cache once consumed,
+ * which keeps the page cache footprint of a one-pass scan bounded (see
+ * ioutils_stream_advance).
+ */
+void set_streaming_group_sg(SGGroup_t *sggroup, int enable);
+
 /* Print string representation of scatter-gather group to stdout.
  */
 void print_group_sg(const char *ldr, const SGGroup_t *sggroup);
@@ -127,6 +205,8 @@ typedef struct FFile {
 	int index;
 	// byte size of packets
 	int packet_size;
+	// streaming mode state
+	IOStream_t stream;
 } FFile_t;
 
 /* Open a flat file. The referenced FFile_t struct is initialized and
@@ -142,9 +222,10 @@ int open_file_f(const char *filename, FFile_t *ffile);
 void close_file_f(FFile_t *ffile);
 
 /* Read number of packets from flat file and store store them in a
- * buffer. Buffer memory is allocated dynamically and should be freed
- * manually after use. The flat file should be open, and its index is
- * advanced by the read.
+ * buffer. Buffer memory is allocated with memutils_alloc, under the
+ * current memory policy, and should be released with
+ * free_packets_file_f (not free) after use. The flat file should be
+ * open, and its index is advanced by the read.
  * 
  * Returns number of packets read (can be less than requested number of
  * packets if end-of-file reached), 0 when no more packets could be
@@ -155,4 +236,96 @@ void close_file_f(FFile_t *ffile);
  */
 int read_packets_from_file_f(FFile_t *ffile, int num_packets, void **buf);
 
+/* Release a buffer returned by read_packets_from_file_f. Does nothing
+ * if buf is NULL.
+ */
+void free_packets_file_f(void *buf);
+
+/* Read number of packets from flat file and store them in a buffer
+ * provided by the caller, which should be large enough to hold
+ * num_packets packets. Otherwise the same as read_packets_from_file_f.
+ */
+int read_packets_into_file_f(FFile_t *ffile, int num_packets, void *buf);
+
+/* Enable (enable != 0) or disable (enable == 0) streaming mode on a
+ * flat file, see set_streaming_group_sg.
+ */
+void set_streaming_file_f(FFile_t *ffile, int enable);
+
+////////////////////////////////////////////////// MULTI-FILE FLAT STREAMS
+/* Number of bytes left in the current file below which the next file
+ * in a stream is opened and the start of it is prefetched.
+ */
+#define FSTREAM_PREFETCH_BYTES (64*1024*1024)
+
+/* Encapsulates an ordered list of flat files that is read as a single
+ * continuous packet stream.
+ */
+typedef struct FStream {
+	// filenames in stream order
+	char **filenames;
+	// number of files in stream
+	int file_count;
+	// byte size of packets, same for all files
+	int packet_size;
+	// index in filenames of the current file
+	int current_index;
+	// file currently being read
+	FFile_t current;
+	// byte size of current file
+	off_t current_size;
+	// file after the current one, opened ahead of time
+	FFile_t next;
+	// 1 if next is open, 0 otherwise
+	int next_open;
+	// 1 if streaming mode is enabled on the files, 0 otherwise
+	int streaming;
+	// counts number of packets already read
+	int64_t index;
+} FStream_t;
+
+/* Open an ordered list of flat files as a single stream. The first
+ * header of every file is checked, and all files should have the same
+ * frame length. The referenced FStream_t struct is initialized and
+ * should be used in subsequent calls to *_stream_f functions.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int open_stream_f(int num_files, const char *filenames[], FStream_t *fstream);
+
+/* Close a flat file stream. All dynamically allocated memory associated
+ * with the FStream_t struct is freed.
+ */
+void close_stream_f(FStream_t *fstream);
+
+/* Read number of packets from a flat file stream and store them in a
+ * buffer. Buffer memory is allocated with memutils_alloc, under the
+ * current memory policy, and should be released with
+ * free_packets_stream_f (not free) after use. Reads continue across
+ * file boundaries, and the next file is opened and prefetched before
+ * the current one is exhausted. Trailing bytes that do not form a complete packet at the
+ * end of a file are skipped.
+ * 
+ * Returns number of packets read (can be less than requested number of
+ * packets if the end of the last file is reached), 0 when no more
+ * packets could be read, and -1 when an error occurs.
+ */
+int read_packets_from_stream_f(FStream_t *fstream, int num_packets, void **buf);
+
+/* Release a buffer returned by read_packets_from_stream_f. Does nothing
+ * if buf is NULL.
+ */
+void free_packets_stream_f(void *buf);
+
+/* Read number of packets from a flat file stream and store them in a
+ * buffer provided by the caller, which should be large enough to hold
+ * num_packets packets. Otherwise the same as read_packets_from_stream_f.
+ */
+int read_packets_into_stream_f(FStream_t *fstream, int num_packets, void *buf);
+
+/* Enable (enable != 0) or disable (enable == 0) streaming mode on all
+ * files in a flat file stream, see set_streaming_group_sg.
+ */
+void set_streaming_stream_f(FStream_t *fstream, int enable);
+
 #endif // VDIF_FILES_H
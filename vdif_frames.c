@@ -1,9 +1,38 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "memutils.h"
 #include "vdif_frames.h"
 
 int get_samples(vdif_header_t *frm, uint32_t **out, int *nch, int *bps, int *cmp) {
+	int num;
+	
+	num = count_samples(frm);
+	if (num == 0) {
+		return num;
+	}
+	*out = (uint32_t *)memutils_alloc(num*sizeof(uint32_t));
+	return get_samples_into(frm,*out,nch,bps,cmp);
+}
+
+void free_samples(uint32_t *out) {
+	memutils_free(out);
+}
+
+int count_samples(vdif_header_t *frm) {
+	int samp_per_w32;
+	int w32len_data;
+	
+	if (frm->invalid_data) {
+		return 0;
+	}
+	samp_per_w32 = 32 / (frm->bits_per_sample+1);
+	// payload length, frame_length is given as 8-byte words
+	w32len_data = (frm->frame_length*8 - sizeof(vdif_header_t))/4;
+	return w32len_data*samp_per_w32;
+}
+
+int get_samples_into(vdif_header_t *frm, uint32_t *out, int *nch, int *bps, int *cmp) {
 	int ii, jj;
 	int mask;
 	int num = 0;
@@ -21,10 +50,9 @@ int get_samples(vdif_header_t *frm, uint32_t **out, int *nch, int *bps, int *cmp
 	// payload length, frame_length is given as 8-byte words
 	w32len_data = (frm->frame_length*8 - sizeof(vdif_header_t))/4;
 	num = w32len_data*samp_per_w32;
-	*out = (int32_t *)malloc(num*sizeof(int32_t));
 	mask = (0x01 << (*bps)) - 1;
-	data_out = *out;
-	data_in = (int32_t *)((void *)frm + sizeof(vdif_header_t));
+	data_out = out;
+	data_in = (uint32_t *)((void *)frm + sizeof(vdif_header_t));
 	for (ii=0; ii<w32len_data; ii++) {
 		for (jj=0; jj<samp_per_w32; jj++) {
 			*data_out = ((*data_in) >> jj*(*bps)) & mask;
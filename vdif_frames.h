@@ -48,8 +48,26 @@ typedef struct vdif_header {
  *  in the memory allocated to *out. The number of channels, bits per
  *  sample, and number of components (1 for real, or 2 for real +
  *  imaginary) are stored in *nch, *bps, and *cmp, respectively. The
- *  total number of samples read is returned.
+ *  total number of samples read is returned. Memory is allocated with
+ *  memutils_alloc, under the current memory policy, and should be
+ *  released with free_samples (not free) after use.
  */
 int get_samples(vdif_header_t *frm, uint32_t **out, int *nch, int *bps, int *cmp);
 
+/* Release sample memory allocated by get_samples. Does nothing if out is
+ * NULL.
+ */
+void free_samples(uint32_t *out);
+
+/* Return the number of samples that get_samples will extract from the
+ * given VDIF frame, or 0 if the frame is marked invalid.
+ */
+int count_samples(vdif_header_t *frm);
+
+/* Extract samples from the given VDIF frame into a buffer provided by
+ * the caller, which should hold at least count_samples(frm) values.
+ * Otherwise the same as get_samples.
+ */
+int get_samples_into(vdif_header_t *frm, uint32_t *out, int *nch, int *bps, int *cmp);
+
 #endif // VDIF_FRAMES_H
@@ -0,0 +1,491 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "memutils.h"
+#include "vdif_frames.h"
+#include "vdif_pcal.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+// selects the low two bits of every nibble, and the low nibble of every
+// byte, of a 64-bit word
+#define PCAL_MASK_2BIT 0x3333333333333333ULL
+#define PCAL_MASK_4BIT 0x0F0F0F0F0F0F0F0FULL
+
+/* Return greatest common divisor of a and b.
+ */
+static int64_t gcd_pcal(int64_t a, int64_t b) {
+	int64_t tmp;
+	
+	while (b != 0) {
+		tmp = a % b;
+		a = b;
+		b = tmp;
+	}
+	return a;
+}
+
+/* Add the 2-bit codes in count words of sample data to the packed
+ * counters of count consecutive fold words. Lane r of a fold word holds
+ * in byte j the counter of sample 4*j+r within the word, which lets the
+ * codes be spread into bytes with shifts and masks only.
+ */
+static void fold_words_pcal(uint64_t *packed, const uint64_t *data, int count) {
+	int ii;
+	uint64_t lo, hi;
+	
+	for (ii=0; ii<count; ii++) {
+		lo = data[ii] & PCAL_MASK_2BIT;
+		hi = (data[ii] >> 2) & PCAL_MASK_2BIT;
+		packed[4*ii] += lo & PCAL_MASK_4BIT;
+		packed[4*ii+1] += hi & PCAL_MASK_4BIT;
+		packed[4*ii+2] += (lo >> 4) & PCAL_MASK_4BIT;
+		packed[4*ii+3] += (hi >> 4) & PCAL_MASK_4BIT;
+	}
+}
+
+/* Empty the packed counters of one chunk into the fold buffer.
+ */
+static void unpack_chunk_pcal(PCalWorker_t *worker, int chunk) {
+	int ii, jj, kk;
+	int end;
+	uint64_t tmp;
+	uint32_t *fold;
+	
+	end = (chunk+1)*PCAL_CHUNK_WORDS;
+	if (end > worker->pcal->period_words) {
+		end = worker->pcal->period_words;
+	}
+	for (ii=chunk*PCAL_CHUNK_WORDS; ii<end; ii++) {
+		fold = &worker->fold[ii*PCAL_WORD_SAMPLES];
+		for (jj=0; jj<4; jj++) {
+			tmp = worker->packed[4*ii+jj];
+			for (kk=0; kk<8; kk++) {
+				fold[4*kk+jj] += (tmp >> 8*kk) & 0xFF;
+			}
+			worker->packed[4*ii+jj] = 0;
+		}
+	}
+	worker->passes[chunk] = 0;
+}
+
+/* Fold the samples of one frame, which start at fold word slot.
+ */
+static void fold_frame_pcal(PCalWorker_t *worker, const uint64_t *data, int slot) {
+	int chunk;
+	int count;
+	int remaining;
+	int period_words;
+	
+	period_words = worker->pcal->period_words;
+	remaining = worker->pcal->frame_samples/PCAL_WORD_SAMPLES;
+	while (remaining > 0) {
+		// fold at most up to the end of the chunk, which is never past
+		// the end of the period
+		chunk = slot/PCAL_CHUNK_WORDS;
+		count = (chunk+1)*PCAL_CHUNK_WORDS - slot;
+		if (count > period_words - slot) {
+			count = period_words - slot;
+		}
+		if (count > remaining) {
+			count = remaining;
+		}
+		if (worker->passes[chunk] == PCAL_PACKED_PASSES) {
+			unpack_chunk_pcal(worker,chunk);
+		}
+		worker->passes[chunk]++;
+		fold_words_pcal(&worker->packed[4*slot],data,count);
+		data += count;
+		remaining -= count;
+		slot += count;
+		if (slot == period_words) {
+			slot = 0;
+		}
+	}
+}
+
+/* Job that folds the packets assigned to a worker.
+ */
+static void fold_packets_pcal(void *arg) {
+	int ii;
+	int packet_size;
+	uint64_t slot;
+	PCalWorker_t *worker = (PCalWorker_t *)arg;
+	PCal_t *pcal = worker->pcal;
+	vdif_header_t *hdr;
+	
+	packet_size = pcal->frame_samples/4 + sizeof(vdif_header_t);
+	for (ii=0; ii<worker->packet_count; ii++) {
+		hdr = (vdif_header_t *)((char *)worker->packets + (size_t)ii*packet_size);
+		if (hdr->invalid_data || hdr->thread_id != pcal->thread_id ||
+		  hdr->secs_since_epoch != pcal->secs_since_epoch || hdr->ref_epoch != pcal->ref_epoch ||
+		  hdr->frame_length*8 != packet_size) {
+			worker->skipped_frames++;
+			continue;
+		}
+		slot = ((uint64_t)hdr->data_frame*(pcal->frame_samples/PCAL_WORD_SAMPLES)) % pcal->period_words;
+		fold_frame_pcal(worker,(const uint64_t *)((char *)hdr + sizeof(vdif_header_t)),(int)slot);
+		worker->frames++;
+	}
+}
+
+/* Job that empties all packed counters of a worker into its fold
+ * buffer.
+ */
+static void unpack_packets_pcal(void *arg) {
+	int ii;
+	int chunks;
+	PCalWorker_t *worker = (PCalWorker_t *)arg;
+	
+	chunks = (worker->pcal->period_words + PCAL_CHUNK_WORDS - 1)/PCAL_CHUNK_WORDS;
+	for (ii=0; ii<chunks; ii++) {
+		if (worker->passes[ii] > 0) {
+			unpack_chunk_pcal(worker,ii);
+		}
+	}
+}
+
+/* Job that computes amplitude and phase of the tones assigned to a
+ * worker from the merged fold buffer.
+ */
+static void transform_tones_pcal(void *arg) {
+	int ii, jj;
+	int idx;
+	int step;
+	int64_t frames;
+	double re, im;
+	double samples;
+	PCalWorker_t *worker = (PCalWorker_t *)arg;
+	PCal_t *pcal = worker->pcal;
+	
+	frames = 0;
+	for (ii=0; ii<pcal->worker_count; ii++) {
+		frames += pcal->workers[ii].frames;
+	}
+	samples = (double)frames*pcal->frame_samples;
+	for (ii=worker->tone_start; ii<worker->tone_end; ii++) {
+		re = 0.0;
+		im = 0.0;
+		idx = 0;
+		step = pcal->tone_bins[ii];
+		for (jj=0; jj<pcal->period; jj++) {
+			re += pcal->fold[jj]*pcal->rotator_re[idx];
+			im += pcal->fold[jj]*pcal->rotator_im[idx];
+			idx += step;
+			if (idx >= pcal->period) {
+				idx -= pcal->period;
+			}
+		}
+		// the 2-bit levels are 2*code-3, the constant term does not
+		// contribute to tones at non-zero frequency
+		pcal->amplitude[ii] = samples > 0 ? 4.0*sqrt(re*re + im*im)/samples : 0.0;
+		pcal->phase[ii] = atan2(im,re);
+	}
+}
+
+/* Run func once for every worker, on the pool if there is more than one
+ * worker, and wait for all of them to finish.
+ */
+static void run_workers_pcal(PCal_t *pcal, WPJobFunc_t func) {
+	int ii;
+	
+	if (pcal->worker_count == 1) {
+		func(&pcal->workers[0]);
+		return;
+	}
+	for (ii=0; ii<pcal->worker_count; ii++) {
+		if (workpool_submit(&pcal->pool,func,&pcal->workers[ii],0,NULL) == -1) {
+			// run the job here rather than lose its share of the data
+			func(&pcal->workers[ii]);
+		}
+	}
+	workpool_wait(&pcal->pool);
+}
+
+/* Split packets evenly over the workers and fold them in parallel.
+ */
+static void fold_range_pcal(PCal_t *pcal, const void *packets, int packet_count, int packet_size) {
+	int ii;
+	int start;
+	int end;
+	
+	if (packet_count == 0) {
+		return;
+	}
+	for (ii=0; ii<pcal->worker_count; ii++) {
+		start = (int)((int64_t)packet_count*ii/pcal->worker_count);
+		end = (int)((int64_t)packet_count*(ii+1)/pcal->worker_count);
+		pcal->workers[ii].packets = (const char *)packets + (size_t)start*packet_size;
+		pcal->workers[ii].packet_count = end - start;
+	}
+	run_workers_pcal(pcal,fold_packets_pcal);
+}
+
+/* Check that the first valid frame can be processed, and take thread
+ * and frame size from it.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+static int first_frame_pcal(PCal_t *pcal, const vdif_header_t *hdr, int packet_size) {
+	if (hdr->bits_per_sample != 1 || hdr->log2_chans != 0 || hdr->complex) {
+		fprintf(stderr,
+		  "%s.%s(%d): only real single-channel 2-bit data supported, got %d bits, %d channels, complex %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  hdr->bits_per_sample+1,0x01 << hdr->log2_chans,hdr->complex);
+		return -1;
+	}
+	if (hdr->frame_length*8 != packet_size) {
+		fprintf(stderr,
+		  "%s.%s(%d): frame length %d does not match packet size %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  hdr->frame_length*8,packet_size);
+		return -1;
+	}
+	pcal->thread_id = hdr->thread_id;
+	pcal->frame_samples = (packet_size - sizeof(vdif_header_t))*4;
+	return 1;
+}
+
+////////////////////////////////////////////////////////////// EXTRACTOR
+
+int init_pcal(PCal_t *pcal, int64_t sample_rate, int64_t spacing, int64_t offset, int thread_count, PCalOutputFunc_t output, void *output_arg) {
+	int ii;
+	int chunks;
+	int64_t tmp;
+	int64_t step;
+	int64_t period;
+	int64_t freq;
+	PCalWorker_t *worker;
+	
+	memset(pcal,0,sizeof(PCal_t));
+	pcal->thread_id = -1;
+	if (sample_rate <= 0 || spacing <= 0 || offset < 0 || thread_count < 1) {
+		fprintf(stderr,
+		  "%s.%s(%d): invalid arguments, sample rate %lld, spacing %lld, offset %lld, threads %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  (long long)sample_rate,(long long)spacing,(long long)offset,thread_count);
+		return -1;
+	}
+	pcal->sample_rate = sample_rate;
+	pcal->spacing = spacing;
+	pcal->offset = offset;
+	pcal->output = output;
+	pcal->output_arg = output_arg;
+	// all tones are multiples of step, so the comb repeats after
+	// sample_rate/step samples, which is rounded up to whole words
+	step = gcd_pcal(gcd_pcal(sample_rate,spacing),offset);
+	period = sample_rate/step;
+	period = period/gcd_pcal(period,PCAL_WORD_SAMPLES)*PCAL_WORD_SAMPLES;
+	if (period > PCAL_MAX_PERIOD) {
+		fprintf(stderr,
+		  "%s.%s(%d): fold period of %lld samples exceeds maximum of %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  (long long)period,PCAL_MAX_PERIOD);
+		return -1;
+	}
+	pcal->period = (int)period;
+	pcal->period_words = pcal->period/PCAL_WORD_SAMPLES;
+	for (freq=offset; 2*freq<sample_rate; freq+=spacing) {
+		if (freq > 0) {
+			pcal->tone_count++;
+		}
+	}
+	if (pcal->tone_count == 0) {
+		fprintf(stderr,
+		  "%s.%s(%d): no tones below Nyquist frequency\n",
+		  __FILE__,__FUNCTION__,__LINE__);
+		return -1;
+	}
+	pcal->rotator_re = (double *)malloc(pcal->period*sizeof(double));
+	pcal->rotator_im = (double *)malloc(pcal->period*sizeof(double));
+	pcal->frequency = (double *)malloc(pcal->tone_count*sizeof(double));
+	pcal->tone_bins = (int *)malloc(pcal->tone_count*sizeof(int));
+	pcal->amplitude = (double *)calloc(pcal->tone_count,sizeof(double));
+	pcal->phase = (double *)calloc(pcal->tone_count,sizeof(double));
+	pcal->fold = (double *)malloc(pcal->period*sizeof(double));
+	pcal->workers = (PCalWorker_t *)calloc(thread_count,sizeof(PCalWorker_t));
+	if (pcal->rotator_re == NULL || pcal->rotator_im == NULL || pcal->frequency == NULL ||
+	  pcal->tone_bins == NULL || pcal->amplitude == NULL || pcal->phase == NULL ||
+	  pcal->fold == NULL || pcal->workers == NULL) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to allocate tables\n",
+		  __FILE__,__FUNCTION__,__LINE__);
+		destroy_pcal(pcal);
+		return -1;
+	}
+	for (ii=0; ii<pcal->period; ii++) {
+		pcal->rotator_re[ii] = cos(2.0*M_PI*ii/pcal->period);
+		pcal->rotator_im[ii] = -sin(2.0*M_PI*ii/pcal->period);
+	}
+	ii = 0;
+	for (freq=offset; 2*freq<sample_rate; freq+=spacing) {
+		if (freq > 0) {
+			// tone completes freq/step cycles in sample_rate/step samples
+			tmp = (freq/step)*(period/(sample_rate/step));
+			pcal->frequency[ii] = (double)freq;
+			pcal->tone_bins[ii] = (int)(tmp % period);
+			ii++;
+		}
+	}
+	if (thread_count > 1) {
+		if (workpool_init(&pcal->pool,thread_count,0) == -1) {
+			destroy_pcal(pcal);
+			return -1;
+		}
+	}
+	// workers are zeroed, so destroy_pcal can free partially set up ones
+	pcal->worker_count = thread_count;
+	chunks = (pcal->period_words + PCAL_CHUNK_WORDS - 1)/PCAL_CHUNK_WORDS;
+	for (ii=0; ii<thread_count; ii++) {
+		worker = &pcal->workers[ii];
+		worker->pcal = pcal;
+		worker->packed = (uint64_t *)memutils_alloc(4*pcal->period_words*sizeof(uint64_t));
+		worker->passes = (uint8_t *)calloc(chunks,sizeof(uint8_t));
+		worker->fold = (uint32_t *)memutils_alloc(pcal->period*sizeof(uint32_t));
+		if (worker->packed == NULL || worker->passes == NULL || worker->fold == NULL) {
+			fprintf(stderr,
+			  "%s.%s(%d): unable to allocate fold buffers\n",
+			  __FILE__,__FUNCTION__,__LINE__);
+			destroy_pcal(pcal);
+			return -1;
+		}
+		memset(worker->packed,0,4*pcal->period_words*sizeof(uint64_t));
+		memset(worker->fold,0,pcal->period*sizeof(uint32_t));
+		worker->tone_start = (int)((int64_t)pcal->tone_count*ii/thread_count);
+		worker->tone_end = (int)((int64_t)pcal->tone_count*(ii+1)/thread_count);
+	}
+	return 1;
+}
+
+int process_packets_pcal(PCal_t *pcal, const void *packets, int packet_count, int packet_size) {
+	int ii;
+	int start;
+	uint64_t secs;
+	uint64_t current;
+	const vdif_header_t *hdr;
+	
+	if (pcal->frame_samples > 0 && packet_size != pcal->frame_samples/4 + (int)sizeof(vdif_header_t)) {
+		fprintf(stderr,
+		  "%s.%s(%d): packet size %d differs from earlier packets\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  packet_size);
+		return -1;
+	}
+	ii = 0;
+	while (ii < packet_count) {
+		// find the run of packets up to the first one of a later second
+		start = ii;
+		for (; ii<packet_count; ii++) {
+			hdr = (const vdif_header_t *)((const char *)packets + (size_t)ii*packet_size);
+			if (hdr->invalid_data) {
+				continue;
+			}
+			if (pcal->thread_id == -1) {
+				if (first_frame_pcal(pcal,hdr,packet_size) == -1) {
+					return -1;
+				}
+			}
+			if (hdr->thread_id != pcal->thread_id) {
+				continue;
+			}
+			secs = ((uint64_t)hdr->ref_epoch << 32) | hdr->secs_since_epoch;
+			current = ((uint64_t)pcal->ref_epoch << 32) | pcal->secs_since_epoch;
+			if (!pcal->secs_open) {
+				pcal->secs_since_epoch = hdr->secs_since_epoch;
+				pcal->ref_epoch = hdr->ref_epoch;
+				pcal->secs_open = 1;
+			} else if (secs > current) {
+				break;
+			}
+		}
+		fold_range_pcal(pcal,(const char *)packets + (size_t)start*packet_size,ii-start,packet_size);
+		if (ii < packet_count) {
+			flush_pcal(pcal);
+			pcal->secs_since_epoch = hdr->secs_since_epoch;
+			pcal->ref_epoch = hdr->ref_epoch;
+			pcal->secs_open = 1;
+		}
+	}
+	return 1;
+}
+
+void flush_pcal(PCal_t *pcal) {
+	int ii, jj;
+	uint32_t *fold;
+	PCalSecond_t second;
+	
+	if (!pcal->secs_open) {
+		return;
+	}
+	run_workers_pcal(pcal,unpack_packets_pcal);
+	memset(pcal->fold,0,pcal->period*sizeof(double));
+	for (ii=0; ii<pcal->worker_count; ii++) {
+		fold = pcal->workers[ii].fold;
+		for (jj=0; jj<pcal->period; jj++) {
+			pcal->fold[jj] += fold[jj];
+			fold[jj] = 0;
+		}
+	}
+	run_workers_pcal(pcal,transform_tones_pcal);
+	second.secs_since_epoch = pcal->secs_since_epoch;
+	second.ref_epoch = pcal->ref_epoch;
+	second.frames = 0;
+	second.skipped_frames = pcal->skipped_frames;
+	for (ii=0; ii<pcal->worker_count; ii++) {
+		second.frames += pcal->workers[ii].frames;
+		second.skipped_frames += pcal->workers[ii].skipped_frames;
+		pcal->workers[ii].frames = 0;
+		pcal->workers[ii].skipped_frames = 0;
+	}
+	second.tone_count = pcal->tone_count;
+	second.frequency = pcal->frequency;
+	second.amplitude = pcal->amplitude;
+	second.phase = pcal->phase;
+	if (pcal->output != NULL) {
+		pcal->output(&second,pcal->output_arg);
+	}
+	pcal->skipped_frames = 0;
+	pcal->secs_open = 0;
+}
+
+void destroy_pcal(PCal_t *pcal) {
+	int ii;
+	
+	if (pcal->workers != NULL) {
+		if (pcal->worker_count > 1) {
+			workpool_destroy(&pcal->pool);
+		}
+		for (ii=0; ii<pcal->worker_count; ii++) {
+			memutils_free(pcal->workers[ii].packed);
+			free(pcal->workers[ii].passes);
+			memutils_free(pcal->workers[ii].fold);
+		}
+		free(pcal->workers);
+	}
+	free(pcal->rotator_re);
+	free(pcal->rotator_im);
+	free(pcal->frequency);
+	free(pcal->tone_bins);
+	free(pcal->amplitude);
+	free(pcal->phase);
+	free(pcal->fold);
+	memset(pcal,0,sizeof(PCal_t));
+}
+
+int stage_pcal(void *arg, PLBatch_t *batch) {
+	return process_packets_pcal((PCal_t *)arg,batch->data,batch->packet_count,batch->packet_size);
+}
+
+void print_second_pcal(const char *ldr, const PCalSecond_t *second) {
+	int ii;
+	
+	fprintf(stdout,"%s{secs: %d@%u, frames: %lld, skipped: %lld, tones: %d}\n",
+	  ldr,second->ref_epoch,second->secs_since_epoch,
+	  (long long)second->frames,(long long)second->skipped_frames,second->tone_count);
+	for (ii=0; ii<second->tone_count; ii++) {
+		fprintf(stdout,"%s  %14.6f MHz  amp %10.6f  phase %8.2f deg\n",
+		  ldr,1e-6*second->frequency[ii],second->amplitude[ii],second->phase[ii]*180.0/M_PI);
+	}
+}
@@ -0,0 +1,169 @@
+#ifndef VDIF_PCAL_H
+#define VDIF_PCAL_H
+
+#include <stdint.h>
+
+#include "vdif_pipeline.h"
+#include "workpool.h"
+
+/* Maximum fold period in samples. The fold period is the shortest
+ * stretch of samples after which the whole phase-cal comb repeats, see
+ * init_pcal.
+ */
+#define PCAL_MAX_PERIOD (1024*1024)
+
+/* Number of samples in one 64-bit word of 2-bit real samples, and the
+ * number of times a packed 8-bit counter can be incremented by the
+ * largest 2-bit code (3) before it overflows.
+ */
+#define PCAL_WORD_SAMPLES 32
+#define PCAL_PACKED_PASSES 85
+
+/* Number of fold words per chunk for which passes over the packed
+ * counters are tracked. Only chunks that are about to overflow are
+ * emptied into the fold buffer.
+ */
+#define PCAL_CHUNK_WORDS 64
+
+/* Phase-cal tones measured over one second of data.
+ */
+typedef struct PCalSecond {
+	// VDIF time of the second
+	uint32_t secs_since_epoch;
+	int ref_epoch;
+	// number of frames folded
+	int64_t frames;
+	// number of frames skipped (invalid, other VDIF thread, or late)
+	int64_t skipped_frames;
+	// number of tones, and per-tone frequency in Hz
+	int tone_count;
+	const double *frequency;
+	// per-tone amplitude, in units where the 2-bit levels are -3, -1, +1
+	// and +3, and phase in radians relative to the start of the second
+	const double *amplitude;
+	const double *phase;
+} PCalSecond_t;
+
+/* Function called with the result for every completed second.
+ */
+typedef void (*PCalOutputFunc_t)(const PCalSecond_t *second, void *arg);
+
+/* Per-thread fold state. Each worker folds its share of every batch
+ * into its own counters, which are merged once per second.
+ */
+typedef struct PCalWorker {
+	// extractor the worker belongs to
+	struct PCal *pcal;
+	// packed 8-bit counters, four words per fold word, one byte per sample
+	uint64_t *packed;
+	// number of passes accumulated in packed counters, per chunk
+	uint8_t *passes;
+	// folded code sums, one per sample in the fold period
+	uint32_t *fold;
+	// packets assigned to the worker in the current batch
+	const void *packets;
+	int packet_count;
+	// first and one-past-last tone computed by the worker
+	int tone_start;
+	int tone_end;
+	// number of frames folded and skipped in the current second
+	int64_t frames;
+	int64_t skipped_frames;
+} PCalWorker_t;
+
+/* Encapsulates a phase-cal tone extractor.
+ */
+typedef struct PCal {
+	// sample rate, tone spacing and frequency of first tone, all in Hz
+	int64_t sample_rate;
+	int64_t spacing;
+	int64_t offset;
+	// fold period in samples, and in 64-bit words of samples
+	int period;
+	int period_words;
+	// rotator table, cos and -sin of 2*pi*n/period for n < period
+	double *rotator_re;
+	double *rotator_im;
+	// number of tones, and per-tone frequency and rotator step
+	int tone_count;
+	double *frequency;
+	int *tone_bins;
+	// per-tone amplitude and phase of the last completed second
+	double *amplitude;
+	double *phase;
+	// fold buffer of all workers merged
+	double *fold;
+	// workers, and the pool that runs them (unused with one worker)
+	PCalWorker_t *workers;
+	int worker_count;
+	WorkPool_t pool;
+	// VDIF thread processed, -1 until the first valid frame is seen
+	int thread_id;
+	// samples per frame, 0 until the first valid frame is seen
+	int frame_samples;
+	// VDIF time of the second being accumulated, valid if secs_open
+	uint32_t secs_since_epoch;
+	int ref_epoch;
+	int secs_open;
+	// number of frames skipped in the current second outside workers
+	int64_t skipped_frames;
+	// function called for every completed second, and its argument
+	PCalOutputFunc_t output;
+	void *output_arg;
+} PCal_t;
+
+/* Initialize a phase-cal tone extractor.
+ * Arguments:
+ *  pcal -- PCal_t struct to initialize
+ *  sample_rate -- sample rate in Hz
+ *  spacing -- tone spacing in Hz
+ *  offset -- frequency of the first tone in Hz, tones at zero frequency
+ *            or at or above the Nyquist frequency are not measured
+ *  thread_count -- number of threads that fold frames in parallel
+ *  output -- function called for every completed second
+ *  output_arg -- argument passed to output
+ * Returns:
+ *  rv -- 1 on success, -1 on failure
+ * Notes:
+ *  Samples are folded modulo the fold period, which is the smallest
+ *  multiple of PCAL_WORD_SAMPLES in which every tone completes a whole
+ *  number of cycles. Once per second the tones are computed from the
+ *  folded samples using a precomputed rotator table, so the cost per
+ *  sample does not depend on the number of tones. Only real-valued
+ *  single-channel 2-bit data can be processed.
+ */
+int init_pcal(PCal_t *pcal, int64_t sample_rate, int64_t spacing, int64_t offset, int thread_count, PCalOutputFunc_t output, void *output_arg);
+
+/* Fold a number of packets of packet_size bytes. Packets may be out of
+ * order within a second, but the second of each packet should not be
+ * earlier than that of the preceding packets; late packets are skipped.
+ * Packets that are marked invalid, or that belong to a different VDIF
+ * thread than the first valid packet, are skipped. The output function
+ * is called whenever a packet starts a new second.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int process_packets_pcal(PCal_t *pcal, const void *packets, int packet_count, int packet_size);
+
+/* Complete the second being accumulated, if any, and call the output
+ * function for it.
+ */
+void flush_pcal(PCal_t *pcal);
+
+/* Free all memory associated with the extractor. Call flush_pcal first
+ * to get the result for the last second.
+ */
+void destroy_pcal(PCal_t *pcal);
+
+/* Pipeline stage that folds all packets in the batch, arg is a PCal_t
+ * pointer. The batch is passed on unchanged. The last second is not
+ * flushed by the stage.
+ */
+int stage_pcal(void *arg, PLBatch_t *batch);
+
+/* Print string representation of PCalSecond_t struct to stdout, with
+ * the given lead string at the start of each line.
+ */
+void print_second_pcal(const char *ldr, const PCalSecond_t *second);
+
+#endif // VDIF_PCAL_H
@@ -0,0 +1,426 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "memutils.h"
+#include "vdif_pipeline.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+/* Return monotonic time in seconds.
+ */
+static double pipeline_time(void) {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (double)ts.tv_sec + 1e-9*(double)ts.tv_nsec;
+}
+
+/* Initialize queue with room for at least size batches.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+static int init_queue(PLQueue_t *queue, int size) {
+	queue->size = 1;
+	while (queue->size < (size_t)size) {
+		queue->size <<= 1;
+	}
+	queue->slots = (PLBatch_t **)calloc(queue->size,sizeof(PLBatch_t *));
+	if (queue->slots == NULL) {
+		return -1;
+	}
+	atomic_init(&queue->head,0);
+	atomic_init(&queue->tail,0);
+	atomic_init(&queue->waiting,0);
+	pthread_mutex_init(&queue->lock,NULL);
+	pthread_cond_init(&queue->ready,NULL);
+	return 1;
+}
+
+/* Push batch onto queue, and wake the consumer if it waits. Called by
+ * the producer only. Queues are sized to hold all batches in the
+ * pipeline, so a push never finds the queue full.
+ */
+static void push_queue(PLQueue_t *queue, PLBatch_t *batch) {
+	size_t tail;
+	
+	tail = atomic_load_explicit(&queue->tail,memory_order_relaxed);
+	queue->slots[tail & (queue->size-1)] = batch;
+	atomic_store_explicit(&queue->tail,tail+1,memory_order_release);
+	// pairs with the fence in wait_queue: either the consumer sees the
+	// new tail, or this sees the waiting flag
+	atomic_thread_fence(memory_order_seq_cst);
+	if (atomic_load_explicit(&queue->waiting,memory_order_relaxed)) {
+		// signal under the lock, so the signal cannot arrive before
+		// the consumer waits
+		pthread_mutex_lock(&queue->lock);
+		pthread_cond_signal(&queue->ready);
+		pthread_mutex_unlock(&queue->lock);
+	}
+}
+
+/* Pop batch from queue. Called by the consumer only.
+ * 
+ * Returns batch, or NULL if the queue is empty.
+ */
+static PLBatch_t *pop_queue(PLQueue_t *queue) {
+	size_t head;
+	PLBatch_t *batch;
+	
+	head = atomic_load_explicit(&queue->head,memory_order_relaxed);
+	if (head == atomic_load_explicit(&queue->tail,memory_order_acquire)) {
+		return NULL;
+	}
+	batch = queue->slots[head & (queue->size-1)];
+	atomic_store_explicit(&queue->head,head+1,memory_order_release);
+	return batch;
+}
+
+/* Pop batch from the stage input queue, waiting until one is available.
+ * This is where backpressure is applied: a stage blocks when upstream
+ * has not produced, and the source blocks when all batches are in
+ * flight downstream.
+ * 
+ * Returns batch, or NULL if the pipeline is aborted.
+ */
+static PLBatch_t *wait_queue(PLStage_t *stage) {
+	double t0;
+	PLBatch_t *batch;
+	
+	batch = pop_queue(stage->in);
+	if (batch != NULL) {
+		return batch;
+	}
+	t0 = pipeline_time();
+	pthread_mutex_lock(&stage->in->lock);
+	atomic_store_explicit(&stage->in->waiting,1,memory_order_relaxed);
+	// pairs with the fence in push_queue
+	atomic_thread_fence(memory_order_seq_cst);
+	while ((batch = pop_queue(stage->in)) == NULL) {
+		if (atomic_load(&stage->pipeline->abort)) {
+			break;
+		}
+		pthread_cond_wait(&stage->in->ready,&stage->in->lock);
+	}
+	atomic_store_explicit(&stage->in->waiting,0,memory_order_relaxed);
+	pthread_mutex_unlock(&stage->in->lock);
+	stage->wait_time += pipeline_time() - t0;
+	return batch;
+}
+
+/* Abort the pipeline and wake all stages that wait for input.
+ */
+static void abort_pipeline(PLPipeline_t *pipeline) {
+	int ii;
+	
+	atomic_store(&pipeline->abort,1);
+	for (ii=0; ii<pipeline->stage_count; ii++) {
+		pthread_mutex_lock(&pipeline->queues[ii].lock);
+		pthread_cond_broadcast(&pipeline->queues[ii].ready);
+		pthread_mutex_unlock(&pipeline->queues[ii].lock);
+	}
+}
+
+/* Thread body for every stage.
+ */
+static void *run_stage(void *arg) {
+	int rv;
+	int is_source;
+	uint64_t sequence = 0;
+	double t0;
+	PLStage_t *stage = (PLStage_t *)arg;
+	PLBatch_t *batch;
+	
+	is_source = stage == &stage->pipeline->stages[0];
+	memutils_bind_thread(memutils_numa_node());
+	stage->status = 1;
+	while ((batch = wait_queue(stage)) != NULL) {
+		if (is_source) {
+			// batches return to the source after the last stage
+			batch->packet_count = 0;
+			batch->samples_per_packet = 0;
+			batch->end_of_stream = 0;
+			batch->sequence = sequence++;
+		} else if (batch->end_of_stream) {
+			push_queue(stage->out,batch);
+			break;
+		}
+		t0 = pipeline_time();
+		rv = stage->func(stage->arg,batch);
+		stage->busy_time += pipeline_time() - t0;
+		if (rv == -1) {
+			fprintf(stderr,
+			  "%s.%s(%d): stage '%s' failed\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  stage->name);
+			stage->status = -1;
+			abort_pipeline(stage->pipeline);
+			break;
+		}
+		if (is_source && rv == 0) {
+			batch->packet_count = 0;
+			batch->end_of_stream = 1;
+			push_queue(stage->out,batch);
+			break;
+		}
+		stage->batches++;
+		stage->packets += batch->packet_count;
+		stage->bytes += (uint64_t)batch->packet_count*batch->packet_size;
+		push_queue(stage->out,batch);
+	}
+	return NULL;
+}
+
+/////////////////////////////////////////////////////////////// PIPELINE
+
+int pipeline_init(PLPipeline_t *pipeline, int packet_size, int batch_packets, int batch_count) {
+	int ii;
+	PLBatch_t *batch;
+	
+	memset(pipeline,0,sizeof(PLPipeline_t));
+	atomic_init(&pipeline->abort,0);
+	pipeline->batches = (PLBatch_t *)calloc(batch_count,sizeof(PLBatch_t));
+	if (pipeline->batches == NULL) {
+		return -1;
+	}
+	pipeline->batch_count = batch_count;
+	for (ii=0; ii<batch_count; ii++) {
+		batch = &pipeline->batches[ii];
+		batch->packet_size = packet_size;
+		batch->packet_capacity = batch_packets;
+		batch->data = memutils_alloc((size_t)batch_packets*packet_size);
+		if (batch->data == NULL) {
+			fprintf(stderr,
+			  "%s.%s(%d): unable to allocate batch of %d packets\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  batch_packets);
+			pipeline_destroy(pipeline);
+			return -1;
+		}
+	}
+	return 1;
+}
+
+int pipeline_add_stage(PLPipeline_t *pipeline, const char *name, PLStageFunc_t func, void *arg) {
+	PLStage_t *stage;
+	
+	if (pipeline->stage_count == PIPELINE_MAX_STAGES) {
+		fprintf(stderr,
+		  "%s.%s(%d): cannot add stage '%s', maximum of %d stages reached\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  name,PIPELINE_MAX_STAGES);
+		return -1;
+	}
+	if (init_queue(&pipeline->queues[pipeline->stage_count],pipeline->batch_count) == -1) {
+		return -1;
+	}
+	stage = &pipeline->stages[pipeline->stage_count];
+	memset(stage,0,sizeof(PLStage_t));
+	stage->name = name;
+	stage->func = func;
+	stage->arg = arg;
+	stage->pipeline = pipeline;
+	pipeline->stage_count++;
+	return 1;
+}
+
+int pipeline_run(PLPipeline_t *pipeline) {
+	int ii;
+	int rv = 1;
+	int started;
+	double t0;
+	PLStage_t *stage;
+	
+	if (pipeline->stage_count == 0) {
+		return -1;
+	}
+	// connect stages in a ring, and hand all batches to the source
+	for (ii=0; ii<pipeline->stage_count; ii++) {
+		stage = &pipeline->stages[ii];
+		stage->in = &pipeline->queues[(ii+pipeline->stage_count-1) % pipeline->stage_count];
+		stage->out = &pipeline->queues[ii];
+	}
+	for (ii=0; ii<pipeline->batch_count; ii++) {
+		push_queue(pipeline->stages[0].in,&pipeline->batches[ii]);
+	}
+	t0 = pipeline_time();
+	for (started=0; started<pipeline->stage_count; started++) {
+		stage = &pipeline->stages[started];
+		if ((errno = pthread_create(&stage->thread,NULL,run_stage,stage)) != 0) {
+			perror("vdif_pipeline.c.pipeline_run(): ");
+			abort_pipeline(pipeline);
+			rv = -1;
+			break;
+		}
+	}
+	for (ii=0; ii<started; ii++) {
+		pthread_join(pipeline->stages[ii].thread,NULL);
+		if (pipeline->stages[ii].status == -1) {
+			rv = -1;
+		}
+	}
+	pipeline->elapsed_time = pipeline_time() - t0;
+	return rv;
+}
+
+void pipeline_destroy(PLPipeline_t *pipeline) {
+	int ii;
+	
+	for (ii=0; ii<pipeline->stage_count; ii++) {
+		if (pipeline->queues[ii].slots != NULL) {
+			free(pipeline->queues[ii].slots);
+			pipeline->queues[ii].slots = NULL;
+			pthread_mutex_destroy(&pipeline->queues[ii].lock);
+			pthread_cond_destroy(&pipeline->queues[ii].ready);
+		}
+	}
+	if (pipeline->batches != NULL) {
+		for (ii=0; ii<pipeline->batch_count; ii++) {
+			memutils_free(pipeline->batches[ii].data);
+			memutils_free(pipeline->batches[ii].samples);
+		}
+		free(pipeline->batches);
+		pipeline->batches = NULL;
+	}
+	pipeline->stage_count = 0;
+	pipeline->batch_count = 0;
+}
+
+void print_pipeline(const char *ldr, const PLPipeline_t *pipeline) {
+	int ii;
+	double elapsed;
+	const PLStage_t *stage;
+	
+	elapsed = pipeline->elapsed_time > 0.0 ? pipeline->elapsed_time : 1.0;
+	for (ii=0; ii<pipeline->stage_count; ii++) {
+		stage = &pipeline->stages[ii];
+		fprintf(stdout,
+		  "%s{stage: '%s', batches: %llu, packets: %llu, MB/s: %.1f, busy: %.1f%%, waiting: %.1f%%}\n",
+		  ldr,stage->name,(unsigned long long)stage->batches,(unsigned long long)stage->packets,
+		  1e-6*stage->bytes/elapsed,100.0*stage->busy_time/elapsed,100.0*stage->wait_time/elapsed);
+	}
+}
+
+////////////////////////////////////////////////////////// STAGE LIBRARY
+
+int pipeline_read_file_f(void *arg, PLBatch_t *batch) {
+	int rv;
+	
+	rv = read_packets_into_file_f((FFile_t *)arg,batch->packet_capacity,batch->data);
+	if (rv == -1) {
+		return -1;
+	}
+	batch->packet_count = rv;
+	return rv > 0 ? 1 : 0;
+}
+
+int pipeline_read_stream_f(void *arg, PLBatch_t *batch) {
+	int rv;
+	
+	rv = read_packets_into_stream_f((FStream_t *)arg,batch->packet_capacity,batch->data);
+	if (rv == -1) {
+		return -1;
+	}
+	batch->packet_count = rv;
+	return rv > 0 ? 1 : 0;
+}
+
+int pipeline_read_group_sg(void *arg, PLBatch_t *batch) {
+	int rv;
+	
+	rv = read_packets_into_group_sg((SGGroup_t *)arg,batch->packet_capacity,batch->data);
+	if (rv == -1) {
+		return -1;
+	}
+	batch->packet_count = rv;
+	return rv > 0 ? 1 : 0;
+}
+
+int pipeline_filter_headers(void *arg, PLBatch_t *batch) {
+	int ii;
+	int kept = 0;
+	PLFilter_t *filter = (PLFilter_t *)arg;
+	void *pkt;
+	
+	for (ii=0; ii<batch->packet_count; ii++) {
+		pkt = batch->data + (size_t)ii*batch->packet_size;
+		if (filter->accept((const vdif_header_t *)pkt,filter->arg)) {
+			if (kept != ii) {
+				memcpy(batch->data + (size_t)kept*batch->packet_size,pkt,batch->packet_size);
+			}
+			kept++;
+		}
+	}
+	batch->packet_count = kept;
+	return 1;
+}
+
+int pipeline_accept_valid(const vdif_header_t *hdr, void *arg) {
+	(void)arg;
+	return !hdr->invalid_data;
+}
+
+int pipeline_unpack(void *arg, PLBatch_t *batch) {
+	int ii;
+	int nch, bps, cmp;
+	size_t needed;
+	uint32_t *samples;
+	vdif_header_t *hdr;
+	
+	(void)arg;
+	// all packets in a stream have the same layout, take the first valid
+	batch->samples_per_packet = 0;
+	for (ii=0; ii<batch->packet_count; ii++) {
+		hdr = (vdif_header_t *)(batch->data + (size_t)ii*batch->packet_size);
+		if (hdr->frame_length*8 == batch->packet_size &&
+		  (batch->samples_per_packet = count_samples(hdr)) > 0) {
+			break;
+		}
+	}
+	needed = (size_t)batch->samples_per_packet*batch->packet_count;
+	if (needed > batch->samples_capacity) {
+		memutils_free(batch->samples);
+		batch->samples = (uint32_t *)memutils_alloc(needed*sizeof(uint32_t));
+		if (batch->samples == NULL) {
+			batch->samples_capacity = 0;
+			return -1;
+		}
+		batch->samples_capacity = needed;
+	}
+	for (ii=0; ii<batch->packet_count && batch->samples_per_packet>0; ii++) {
+		hdr = (vdif_header_t *)(batch->data + (size_t)ii*batch->packet_size);
+		samples = batch->samples + (size_t)ii*batch->samples_per_packet;
+		// a frame length other than packet size would read past the packet
+		if (hdr->frame_length*8 != batch->packet_size ||
+		  count_samples(hdr) != batch->samples_per_packet) {
+			memset(samples,0,batch->samples_per_packet*sizeof(uint32_t));
+			continue;
+		}
+		get_samples_into(hdr,samples,&nch,&bps,&cmp);
+	}
+	return 1;
+}
+
+int pipeline_write_fd(void *arg, PLBatch_t *batch) {
+	int fd = *(int *)arg;
+	ssize_t bytes;
+	size_t done = 0;
+	size_t count;
+	
+	count = (size_t)batch->packet_count*batch->packet_size;
+	while (done < count) {
+		bytes = write(fd,batch->data + done,count - done);
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("vdif_pipeline.c.pipeline_write_fd(): ");
+			return -1;
+		}
+		done += bytes;
+	}
+	return 1;
+}
@@ -0,0 +1,200 @@
+#ifndef VDIF_PIPELINE_H
+#define VDIF_PIPELINE_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+#include "vdif_files.h"
+#include "vdif_frames.h"
+
+/* Defaults for the number of packets in a batch and the number of
+ * batches that circulate through a pipeline. The number of batches
+ * bounds the amount of data in flight, and therefore sets the
+ * backpressure applied to the source stage.
+ */
+#define PIPELINE_BATCH_PACKETS 2048
+#define PIPELINE_BATCH_COUNT 8
+
+/* Maximum number of stages in a pipeline.
+ */
+#define PIPELINE_MAX_STAGES 16
+
+/* Encapsulates a batch of packets that is passed between stages.
+ */
+typedef struct PLBatch {
+	// packet data
+	void *data;
+	// packet size in bytes
+	int packet_size;
+	// number of packets in batch
+	int packet_count;
+	// maximum number of packets in batch
+	int packet_capacity;
+	// unpacked samples, filled by pipeline_unpack
+	uint32_t *samples;
+	// number of samples per packet in samples buffer
+	int samples_per_packet;
+	// maximum number of samples in samples buffer
+	size_t samples_capacity;
+	// sequence number of batch in stream
+	uint64_t sequence;
+	// 1 if this batch marks the end of the stream, 0 otherwise
+	int end_of_stream;
+} PLBatch_t;
+
+/* Bounded single-producer/single-consumer lock-free queue of batches.
+ * Head and tail are kept on separate cache lines so that producer and
+ * consumer do not contend. A consumer that finds the queue empty raises
+ * the waiting flag and blocks on a condition variable, and only then
+ * does the producer take the lock to signal it.
+ */
+typedef struct PLQueue {
+	// ring of batch pointers
+	PLBatch_t **slots;
+	// number of slots, power of two
+	size_t size;
+	// lock and condition variable used to wait for a push
+	pthread_mutex_t lock;
+	pthread_cond_t ready;
+	// index of next slot to pop, written by consumer only
+	_Alignas(64) atomic_size_t head;
+	// 1 while the consumer is blocked or about to block, written by
+	// consumer only
+	atomic_int waiting;
+	// index of next slot to push, written by producer only
+	_Alignas(64) atomic_size_t tail;
+} PLQueue_t;
+
+/* Stage function called once for every batch. A source stage (first in
+ * the pipeline) fills the batch and returns 1, or returns 0 when the
+ * stream is exhausted. Other stages process the batch in-place and
+ * return 1. Any stage returns -1 on error, which aborts the pipeline.
+ */
+typedef int (*PLStageFunc_t)(void *arg, PLBatch_t *batch);
+
+/* Encapsulates a pipeline stage and its throughput metrics.
+ */
+typedef struct PLStage {
+	// name used in metrics output
+	const char *name;
+	// stage function and its argument
+	PLStageFunc_t func;
+	void *arg;
+	// thread that runs the stage
+	pthread_t thread;
+	// queues that connect the stage to its neighbours
+	PLQueue_t *in;
+	PLQueue_t *out;
+	// pipeline the stage belongs to
+	struct PLPipeline *pipeline;
+	// number of batches, packets and bytes processed
+	uint64_t batches;
+	uint64_t packets;
+	uint64_t bytes;
+	// seconds spent in stage function, and waiting for input
+	double busy_time;
+	double wait_time;
+	// return value of stage thread, 1 on success and -1 on failure
+	int status;
+} PLStage_t;
+
+/* Encapsulates a pipeline of stages, the queues that connect them, and
+ * the batches that circulate between them. Batches travel from each
+ * stage to the next, and from the last stage back to the first.
+ */
+typedef struct PLPipeline {
+	// stages in processing order
+	PLStage_t stages[PIPELINE_MAX_STAGES];
+	// number of stages
+	int stage_count;
+	// queues, queue ii feeds stage ii+1 (modulo stage_count)
+	PLQueue_t queues[PIPELINE_MAX_STAGES];
+	// batches owned by the pipeline
+	PLBatch_t *batches;
+	// number of batches
+	int batch_count;
+	// set when a stage fails, stops all stages
+	atomic_int abort;
+	// wall-clock seconds the pipeline ran
+	double elapsed_time;
+} PLPipeline_t;
+
+/* Initialize a pipeline with batch_count batches, each holding up to
+ * batch_packets packets of packet_size bytes.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int pipeline_init(PLPipeline_t *pipeline, int packet_size, int batch_packets, int batch_count);
+
+/* Append a stage to the pipeline. The first stage added is the source.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int pipeline_add_stage(PLPipeline_t *pipeline, const char *name, PLStageFunc_t func, void *arg);
+
+/* Run the pipeline, each stage on its own thread, until the source is
+ * exhausted or a stage fails. The pipeline can be run only once.
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int pipeline_run(PLPipeline_t *pipeline);
+
+/* Free all memory associated with the pipeline.
+ */
+void pipeline_destroy(PLPipeline_t *pipeline);
+
+/* Print per-stage throughput metrics to stdout, with the given lead
+ * string at the start of each line.
+ */
+void print_pipeline(const char *ldr, const PLPipeline_t *pipeline);
+
+////////////////////////////////////////////////////////// STAGE LIBRARY
+/* Source stage reading from a flat file, arg is a FFile_t pointer.
+ */
+int pipeline_read_file_f(void *arg, PLBatch_t *batch);
+
+/* Source stage reading from a multi-file flat stream, arg is a
+ * FStream_t pointer.
+ */
+int pipeline_read_stream_f(void *arg, PLBatch_t *batch);
+
+/* Source stage reading from a scatter-gather group, arg is a SGGroup_t
+ * pointer.
+ */
+int pipeline_read_group_sg(void *arg, PLBatch_t *batch);
+
+/* Header filter called for every packet, returns 1 to keep the packet
+ * and 0 to drop it.
+ */
+typedef int (*PLHeaderFilter_t)(const vdif_header_t *hdr, void *arg);
+
+/* Argument to pipeline_filter_headers.
+ */
+typedef struct PLFilter {
+	// filter function and its argument
+	PLHeaderFilter_t accept;
+	void *arg;
+} PLFilter_t;
+
+/* Stage that drops packets for which the filter returns 0, arg is a
+ * PLFilter_t pointer. Packet order is preserved.
+ */
+int pipeline_filter_headers(void *arg, PLBatch_t *batch);
+
+/* Header filter that keeps only packets not marked invalid.
+ */
+int pipeline_accept_valid(const vdif_header_t *hdr, void *arg);
+
+/* Stage that unpacks all packets in the batch into the batch samples
+ * buffer, see get_samples_into. Packets marked invalid get zero-filled
+ * samples. The arg is not used.
+ */
+int pipeline_unpack(void *arg, PLBatch_t *batch);
+
+/* Stage that writes all packets in the batch to a file, arg is a
+ * pointer to an int file descriptor opened in write-mode.
+ */
+int pipeline_write_fd(void *arg, PLBatch_t *batch);
+
+#endif // VDIF_PIPELINE_H
@@ -0,0 +1,532 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ioutils.h"
+#include "memutils.h"
+#include "vdif_files.h"
+#include "vdif_frames.h"
+#include "vdif_recover.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RECOVER_HAVE_SSE2 1
+#endif
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+// number of bytes of recovered packets collected before they are copied
+// to the output
+#define RECOVER_COPY_SIZE (64*1024*1024)
+
+// index of the header word that holds frame length, number of channels
+// and VDIF version, which is the same for all packets in a stream
+#define RECOVER_KEY_WORD 2
+
+/* State of a recovery scan.
+ */
+typedef struct RScan {
+	// file being scanned, and its streaming state
+	const char *filename;
+	int fd;
+	IOStream_t stream;
+	// output descriptor, or -1
+	int fd_out;
+	// read window, holds window_len bytes from window_offset
+	char *window;
+	off_t window_offset;
+	size_t window_len;
+	// reference header, and its key word
+	vdif_header_t ref;
+	uint32_t key;
+	// latest time of an accepted packet
+	uint32_t last_secs;
+	// default block size from scatter-gather file header
+	int block_size;
+	// block number of last accepted block, -1 if none
+	int last_block_num;
+	// run of recovered packets not yet copied to output
+	off_t run_offset;
+	size_t run_len;
+	// 1 if a read or write failed
+	int io_error;
+	// results
+	RReport_t *report;
+} RScan_t;
+
+/* Return pointer to len bytes at offset in the file, moving the read
+ * window if needed. Len should not exceed RECOVER_WINDOW_SIZE.
+ * 
+ * Returns pointer, or NULL if the file ends before offset+len or on
+ * read error.
+ */
+static const char *peek_rc(RScan_t *scan, off_t offset, size_t len) {
+	ssize_t bytes;
+	size_t count;
+	
+	if (offset >= scan->window_offset && offset + (off_t)len <= scan->window_offset + (off_t)scan->window_len) {
+		return scan->window + (offset - scan->window_offset);
+	}
+	if (offset + (off_t)len > scan->report->size) {
+		return NULL;
+	}
+	count = RECOVER_WINDOW_SIZE;
+	if (scan->report->size - offset < (off_t)count) {
+		count = scan->report->size - offset;
+	}
+	scan->window_offset = offset;
+	scan->window_len = 0;
+	while (scan->window_len < count) {
+		bytes = pread(scan->fd,scan->window + scan->window_len,count - scan->window_len,offset + scan->window_len);
+		if (bytes == -1 && errno == EINTR) {
+			continue;
+		}
+		if (bytes <= 0) {
+			fprintf(stderr,
+			  "%s.%s(%d): read failed at offset %lld in '%s'\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  (long long)(offset + scan->window_len),scan->filename);
+			scan->io_error = 1;
+			return NULL;
+		}
+		scan->window_len += bytes;
+	}
+	ioutils_stream_advance(scan->fd,&scan->stream,offset);
+	return scan->window;
+}
+
+/* Return index of the first occurrence of the four bytes of key in buf,
+ * or -1 if there is none. Sixteen positions are compared per step where
+ * SSE2 is available.
+ */
+static ssize_t search_key_rc(const char *buf, size_t len, uint32_t key) {
+	size_t ii = 0;
+	uint32_t word;
+#ifdef RECOVER_HAVE_SSE2
+	int mask;
+	__m128i match;
+	const unsigned char *kb = (const unsigned char *)&key;
+	__m128i b0 = _mm_set1_epi8((char)kb[0]);
+	__m128i b1 = _mm_set1_epi8((char)kb[1]);
+	__m128i b2 = _mm_set1_epi8((char)kb[2]);
+	__m128i b3 = _mm_set1_epi8((char)kb[3]);
+	
+	for (; ii+19<=len; ii+=16) {
+		match = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf+ii)),b0);
+		match = _mm_and_si128(match,_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf+ii+1)),b1));
+		match = _mm_and_si128(match,_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf+ii+2)),b2));
+		match = _mm_and_si128(match,_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(buf+ii+3)),b3));
+		mask = _mm_movemask_epi8(match);
+		if (mask != 0) {
+			return ii + __builtin_ctz(mask);
+		}
+	}
+#endif
+	for (; ii+4<=len; ii++) {
+		memcpy(&word,buf+ii,sizeof(word));
+		if (word == key) {
+			return ii;
+		}
+	}
+	return -1;
+}
+
+/* Return the key word of a header.
+ */
+static uint32_t key_rc(const vdif_header_t *hdr) {
+	return ((const uint32_t *)hdr)[RECOVER_KEY_WORD];
+}
+
+/* Test if a packet header is plausible given the reference header and
+ * the time of the packets before it.
+ * 
+ * Returns 1 if plausible, 0 otherwise.
+ */
+static int check_header_rc(const RScan_t *scan, const vdif_header_t *hdr) {
+	if (hdr->legacy_mode || key_rc(hdr) != scan->key ||
+	  hdr->station_id != scan->ref.station_id ||
+	  hdr->bits_per_sample != scan->ref.bits_per_sample ||
+	  hdr->complex != scan->ref.complex ||
+	  hdr->ref_epoch != scan->ref.ref_epoch) {
+		return 0;
+	}
+	if ((int64_t)hdr->secs_since_epoch + RECOVER_MAX_TIME_BACK < (int64_t)scan->last_secs ||
+	  (int64_t)hdr->secs_since_epoch > (int64_t)scan->last_secs + RECOVER_MAX_TIME_STEP) {
+		return 0;
+	}
+	return 1;
+}
+
+/* Test if a scatter-gather block header at offset is plausible, and is
+ * followed by a plausible packet header.
+ * 
+ * Returns 1 if plausible, 0 otherwise.
+ */
+static int check_block_rc(RScan_t *scan, off_t offset) {
+	const char *ptr;
+	const sgb_header_t *sgb;
+	
+	ptr = peek_rc(scan,offset,sizeof(sgb_header_t) + sizeof(vdif_header_t));
+	if (ptr == NULL) {
+		return 0;
+	}
+	sgb = (const sgb_header_t *)ptr;
+	if (sgb->block_size <= (int)sizeof(sgb_header_t) || sgb->block_size > scan->block_size ||
+	  (sgb->block_size - sizeof(sgb_header_t)) % scan->report->packet_size != 0) {
+		return 0;
+	}
+	if (sgb->block_num < 0 || (scan->last_block_num >= 0 &&
+	  (sgb->block_num <= scan->last_block_num || sgb->block_num > scan->last_block_num + RECOVER_MAX_BLOCK_STEP))) {
+		return 0;
+	}
+	return check_header_rc(scan,(const vdif_header_t *)(ptr + sizeof(sgb_header_t)));
+}
+
+/* Test if the data after the packet at offset starts with another
+ * packet, or with a block header followed by a packet, judged by key
+ * word only. The end of the file also counts.
+ * 
+ * Returns 1 if confirmed, 0 otherwise.
+ */
+static int confirm_packet_rc(RScan_t *scan, off_t offset) {
+	const char *ptr;
+	off_t next;
+	
+	next = offset + scan->report->packet_size;
+	if (next + (off_t)sizeof(vdif_header_t) > scan->report->size) {
+		return 1;
+	}
+	ptr = peek_rc(scan,next,sizeof(vdif_header_t));
+	if (ptr != NULL && key_rc((const vdif_header_t *)ptr) == scan->key) {
+		return 1;
+	}
+	if (scan->report->is_sg) {
+		ptr = peek_rc(scan,next + sizeof(sgb_header_t),sizeof(vdif_header_t));
+		if (ptr != NULL && key_rc((const vdif_header_t *)ptr) == scan->key) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Copy the pending run of recovered packets to the output.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+static int flush_run_rc(RScan_t *scan) {
+	size_t copied;
+	
+	if (scan->run_len > 0 && scan->fd_out >= 0) {
+		if (ioutils_copy(scan->fd,scan->run_offset,scan->fd_out,scan->run_len,&copied) == -1 ||
+		  copied != scan->run_len) {
+			fprintf(stderr,
+			  "%s.%s(%d): unable to write recovered packets from '%s'\n",
+			  __FILE__,__FUNCTION__,__LINE__,
+			  scan->filename);
+			scan->io_error = 1;
+			return -1;
+		}
+	}
+	scan->run_len = 0;
+	return 1;
+}
+
+/* Accept the packet at offset, adding it to the pending output run.
+ */
+static void accept_packet_rc(RScan_t *scan, off_t offset, const vdif_header_t *hdr) {
+	if (scan->run_len > 0 && (scan->run_offset + (off_t)scan->run_len != offset ||
+	  scan->run_len >= RECOVER_COPY_SIZE)) {
+		flush_run_rc(scan);
+	}
+	if (scan->run_len == 0) {
+		scan->run_offset = offset;
+	}
+	scan->run_len += scan->report->packet_size;
+	if (hdr->secs_since_epoch > scan->last_secs) {
+		scan->last_secs = hdr->secs_since_epoch;
+	}
+	scan->report->packets++;
+}
+
+/* Report a skipped byte range on stderr, which stays clear of packet
+ * data written to stdout.
+ */
+static void skip_rc(RScan_t *scan, off_t start, off_t end, const char *reason) {
+	if (end <= start) {
+		return;
+	}
+	fprintf(stderr,"%s: skipped %lld bytes at offset %lld, %s\n",
+	  scan->filename,(long long)(end - start),(long long)start,reason);
+	scan->report->skipped_ranges++;
+	scan->report->skipped_bytes += end - start;
+}
+
+/* Find the first packet header in the file, which becomes the reference
+ * for all other headers. In a flat file the packet size is taken from
+ * the header, in a scatter-gather file it should match the file header.
+ * A header is only accepted if the next packet has the same key word.
+ * 
+ * Returns offset of the reference header, or -1 if none is found.
+ */
+static off_t lock_rc(RScan_t *scan, off_t start) {
+	int packet_size;
+	off_t offset;
+	const char *ptr;
+	const vdif_header_t *hdr;
+	
+	for (offset=start; offset+(off_t)sizeof(vdif_header_t)<=scan->report->size; offset++) {
+		ptr = peek_rc(scan,offset,sizeof(vdif_header_t));
+		if (ptr == NULL) {
+			return -1;
+		}
+		hdr = (const vdif_header_t *)ptr;
+		packet_size = hdr->frame_length*8;
+		if (hdr->legacy_mode || packet_size <= (int)sizeof(vdif_header_t) ||
+		  packet_size > RECOVER_MAX_PACKET_SIZE ||
+		  (scan->report->is_sg && packet_size != scan->report->packet_size)) {
+			continue;
+		}
+		scan->ref = *hdr;
+		scan->key = key_rc(hdr);
+		scan->report->packet_size = packet_size;
+		if (confirm_packet_rc(scan,offset)) {
+			scan->last_secs = hdr->secs_since_epoch;
+			return offset;
+		}
+	}
+	return -1;
+}
+
+/* Search the range [start,end) for the first plausible block header or
+ * confirmed packet header after start.
+ * 
+ * Returns offset of the header, or -1 if there is none. *at_block is
+ * set to 1 if the offset is that of a block header, and to 0 otherwise.
+ */
+static off_t find_header_rc(RScan_t *scan, off_t start, off_t end, int *at_block) {
+	off_t pos;
+	off_t hdr_offset;
+	size_t len;
+	ssize_t idx;
+	const char *ptr;
+	
+	*at_block = 0;
+	if (end > scan->report->size) {
+		end = scan->report->size;
+	}
+	// key word of a header that starts at or after start
+	pos = start + RECOVER_KEY_WORD*sizeof(uint32_t);
+	while (pos + (off_t)sizeof(uint32_t) <= end && !scan->io_error) {
+		// search what is left of the window before moving it
+		if (pos >= scan->window_offset && pos + (off_t)sizeof(uint32_t) <= scan->window_offset + (off_t)scan->window_len) {
+			len = scan->window_offset + scan->window_len - pos;
+		} else {
+			len = RECOVER_WINDOW_SIZE;
+		}
+		if (end - pos < (off_t)len) {
+			len = end - pos;
+		}
+		ptr = peek_rc(scan,pos,len);
+		if (ptr == NULL) {
+			break;
+		}
+		idx = search_key_rc(ptr,len,scan->key);
+		if (idx < 0) {
+			// keep the last bytes, they may start a match
+			pos += len - (sizeof(uint32_t) - 1);
+			continue;
+		}
+		hdr_offset = pos + idx - RECOVER_KEY_WORD*sizeof(uint32_t);
+		pos += idx + 1;
+		if (scan->report->is_sg && hdr_offset - (off_t)sizeof(sgb_header_t) >= start &&
+		  check_block_rc(scan,hdr_offset - sizeof(sgb_header_t))) {
+			*at_block = 1;
+			return hdr_offset - sizeof(sgb_header_t);
+		}
+		if (hdr_offset > start) {
+			ptr = peek_rc(scan,hdr_offset,sizeof(vdif_header_t));
+			if (ptr != NULL && check_header_rc(scan,(const vdif_header_t *)ptr) &&
+			  confirm_packet_rc(scan,hdr_offset)) {
+				return hdr_offset;
+			}
+		}
+	}
+	return -1;
+}
+
+/* Search forward from offset for the next plausible block header or
+ * confirmed packet header, and report the bytes skipped.
+ * 
+ * Returns offset to continue at, which is the file size if nothing
+ * plausible is left. *at_block is set as by find_header_rc.
+ */
+static off_t resync_rc(RScan_t *scan, off_t offset, const char *reason, int *at_block) {
+	off_t next;
+	
+	next = find_header_rc(scan,offset,scan->report->size,at_block);
+	if (next < 0) {
+		next = scan->report->size;
+	}
+	skip_rc(scan,offset,next,reason);
+	return next;
+}
+
+/* Walk the file from offset, validating every block and packet header
+ * and resynchronizing after each failure.
+ */
+static void scan_rc(RScan_t *scan, off_t offset) {
+	int at_block;
+	off_t block_end;
+	off_t next;
+	const char *ptr;
+	const sgb_header_t *sgb;
+	
+	// -1 while not inside a block with a valid header
+	block_end = -1;
+	at_block = scan->report->is_sg;
+	while (offset < scan->report->size && !scan->io_error) {
+		if (scan->report->is_sg && (at_block || offset == block_end)) {
+			at_block = 0;
+			if (check_block_rc(scan,offset)) {
+				sgb = (const sgb_header_t *)peek_rc(scan,offset,sizeof(sgb_header_t));
+				scan->last_block_num = sgb->block_num;
+				block_end = offset + sgb->block_size;
+				scan->report->blocks++;
+				offset += sizeof(sgb_header_t);
+				continue;
+			}
+			if (offset == block_end || offset + (off_t)sizeof(sgb_header_t) > scan->report->size) {
+				// a block header was expected here
+				block_end = -1;
+				if (offset + (off_t)sizeof(sgb_header_t) > scan->report->size) {
+					skip_rc(scan,offset,scan->report->size,"truncated block header");
+					break;
+				}
+				offset = resync_rc(scan,offset,"invalid block header",&at_block);
+				continue;
+			}
+		}
+		ptr = peek_rc(scan,offset,scan->report->packet_size);
+		if (ptr == NULL) {
+			if (!scan->io_error) {
+				skip_rc(scan,offset,scan->report->size,"truncated packet");
+			}
+			break;
+		}
+		if (!check_header_rc(scan,(const vdif_header_t *)ptr)) {
+			block_end = -1;
+			offset = resync_rc(scan,offset,"invalid packet header",&at_block);
+			continue;
+		}
+		// a packet cut short is followed by a header inside its own span
+		if (!confirm_packet_rc(scan,offset)) {
+			next = find_header_rc(scan,offset,offset + scan->report->packet_size + sizeof(sgb_header_t),&at_block);
+			if (next >= 0) {
+				block_end = -1;
+				skip_rc(scan,offset,next,"truncated packet");
+				offset = next;
+				continue;
+			}
+			ptr = peek_rc(scan,offset,scan->report->packet_size);
+		}
+		accept_packet_rc(scan,offset,(const vdif_header_t *)ptr);
+		offset += scan->report->packet_size;
+		// without a valid block header, each packet may be followed by one
+		if (block_end == -1) {
+			at_block = scan->report->is_sg;
+		}
+	}
+	flush_run_rc(scan);
+}
+
+////////////////////////////////////////////////////////////// RECOVERY
+
+int recover_file_rc(const char *filename, int fd_out, RReport_t *report) {
+	off_t start;
+	off_t offset;
+	struct stat st;
+	sgf_header_t sgf_hdr;
+	RScan_t scan;
+	
+	memset(report,0,sizeof(RReport_t));
+	report->filename = (char *)malloc(strlen(filename) + 1);
+	strcpy(report->filename,filename);
+	report->status = -1;
+	memset(&scan,0,sizeof(RScan_t));
+	scan.filename = report->filename;
+	scan.fd_out = fd_out;
+	scan.last_block_num = -1;
+	scan.block_size = INT_MAX;
+	scan.report = report;
+	scan.fd = open(filename,O_RDONLY);
+	if (scan.fd == -1 || fstat(scan.fd,&st) == -1) {
+		fprintf(stderr,
+		  "%s.%s(%d): unable to open '%s'\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  filename);
+		if (scan.fd != -1) {
+			close(scan.fd);
+		}
+		return -1;
+	}
+	report->size = st.st_size;
+	scan.window = (char *)memutils_alloc(RECOVER_WINDOW_SIZE);
+	if (scan.window == NULL) {
+		close(scan.fd);
+		return -1;
+	}
+	ioutils_stream_init(scan.fd,&scan.stream,0);
+	start = 0;
+	report->is_sg = is_file_sg(filename);
+	if (report->is_sg) {
+		// is_file_sg already read the file header, so it is there
+		memcpy(&sgf_hdr,peek_rc(&scan,0,sizeof(sgf_header_t)),sizeof(sgf_header_t));
+		report->packet_size = sgf_hdr.packet_size;
+		if (sgf_hdr.block_size > (int)sizeof(sgb_header_t)) {
+			scan.block_size = sgf_hdr.block_size;
+		}
+		start = sizeof(sgf_header_t);
+	}
+	offset = lock_rc(&scan,start);
+	if (offset == -1) {
+		report->packet_size = 0;
+		if (!scan.io_error) {
+			skip_rc(&scan,start,report->size,"no valid packet header");
+		}
+	} else if (report->is_sg) {
+		// blocks start right after the file header
+		scan_rc(&scan,start);
+	} else {
+		skip_rc(&scan,start,offset,"no valid packet header");
+		scan_rc(&scan,offset);
+	}
+	ioutils_stream_close(scan.fd,&scan.stream,report->size);
+	memutils_free(scan.window);
+	close(scan.fd);
+	if (scan.io_error) {
+		return -1;
+	}
+	report->status = 1;
+	return 1;
+}
+
+void free_report_rc(RReport_t *report) {
+	if (report->filename != NULL) {
+		free(report->filename);
+		report->filename = NULL;
+	}
+}
+
+void print_report_rc(const char *ldr, const RReport_t *report) {
+	fprintf(stdout,
+	  "%s{filename: '%s', type: '%s', status: %d, size: %lld, packet_size: %d, packets: %lld, "
+	  "blocks: %lld, skipped_ranges: %lld, skipped_bytes: %lld}\n",
+	  ldr,report->filename,report->is_sg ? "sg" : "flat",report->status,(long long)report->size,
+	  report->packet_size,(long long)report->packets,(long long)report->blocks,
+	  (long long)report->skipped_ranges,(long long)report->skipped_bytes);
+}
@@ -0,0 +1,87 @@
+#ifndef VDIF_RECOVER_H
+#define VDIF_RECOVER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Size of the window through which files are read while scanning, in
+ * bytes.
+ */
+#define RECOVER_WINDOW_SIZE (16*1024*1024)
+
+/* Limits used when validating headers:
+ *  RECOVER_MAX_PACKET_SIZE -- largest packet size accepted when looking
+ *                             for the first header of a flat file
+ *  RECOVER_MAX_TIME_BACK -- number of seconds a packet may be earlier
+ *                           than the latest packet before it
+ *  RECOVER_MAX_TIME_STEP -- number of seconds a packet may be later than
+ *                           the latest packet before it
+ *  RECOVER_MAX_BLOCK_STEP -- largest increase of the block number from
+ *                            one scatter-gather block to the next in
+ *                            the same file
+ */
+#define RECOVER_MAX_PACKET_SIZE (1024*1024)
+#define RECOVER_MAX_TIME_BACK 1
+#define RECOVER_MAX_TIME_STEP 3600
+#define RECOVER_MAX_BLOCK_STEP 65536
+
+/* Results of a recovery scan of a single file.
+ */
+typedef struct RReport {
+	// filename of scanned file
+	char *filename;
+	// 1 if scatter-gather file, 0 if flat file
+	int is_sg;
+	// file size in bytes
+	off_t size;
+	// packet size in bytes, 0 if no valid header was found
+	int packet_size;
+	// number of packets that passed validation
+	int64_t packets;
+	// number of scatter-gather block headers that passed validation
+	int64_t blocks;
+	// number of byte ranges skipped, and total number of bytes skipped
+	int64_t skipped_ranges;
+	int64_t skipped_bytes;
+	// 1 if scan completed, -1 if file could not be read
+	int status;
+} RReport_t;
+
+/* Scan a flat or scatter-gather file and recover all packets with a
+ * plausible header.
+ * Arguments:
+ *  filename -- file to scan
+ *  fd_out -- descriptor of file opened in write-mode to which recovered
+ *            packets are appended as a flat file, or -1 to only scan
+ *  report -- RReport_t struct that receives the results, should be
+ *            freed with free_report_rc after use
+ * Returns:
+ *  rv -- 1 on success, -1 on failure
+ * Notes:
+ *  Every header is validated against the first header of the file:
+ *  VDIF version, frame length, number of channels, sample format,
+ *  station and reference epoch should match, and time should not step
+ *  back more than RECOVER_MAX_TIME_BACK seconds or ahead more than
+ *  RECOVER_MAX_TIME_STEP seconds. Scatter-gather block headers should
+ *  have a block size that holds a whole number of packets and does not
+ *  exceed the file header block size, and a block number larger than
+ *  the one before it. A packet that is not followed by another header
+ *  is taken to be cut short if a plausible header starts inside it. On
+ *  the first header that fails validation the file is searched forward
+ *  for the next plausible header, and the skipped byte range is reported
+ *  on stderr. Packets are not reordered, so recovered packets from a
+ *  scatter-gather file are in file order.
+ */
+int recover_file_rc(const char *filename, int fd_out, RReport_t *report);
+
+/* Free all dynamically allocated memory associated with the RReport_t
+ * struct.
+ */
+void free_report_rc(RReport_t *report);
+
+/* Print string representation of RReport_t struct to stdout, with the
+ * given lead string at the start of each line.
+ */
+void print_report_rc(const char *ldr, const RReport_t *report);
+
+#endif // VDIF_RECOVER_H
@@ -0,0 +1,829 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <structmember.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "memutils.h"
+#include "r2dbe_vdif.h"
+#include "vdif_files.h"
+#include "vdif_frames.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+// number of packets per batch when iterating over a reader
+#define VDIFMODULE_BATCH_PACKETS 65536
+
+/* Batch of packets read from file, owns the packet buffer which is
+ * exported through the buffer protocol as a packet_count x packet_size
+ * array of bytes.
+ */
+typedef struct {
+	PyObject_HEAD
+	// packet data, allocated with memutils_alloc
+	char *data;
+	// packet size in bytes
+	int packet_size;
+	// number of packets in batch
+	int packet_count;
+	// shape and strides of exported buffer
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+} BatchObject;
+
+/* Unpacked samples, owns the sample buffer which is exported through
+ * the buffer protocol as a packet_count x samples_per_packet array of
+ * uint32.
+ */
+typedef struct {
+	PyObject_HEAD
+	// samples, allocated with memutils_alloc
+	uint32_t *data;
+	// number of packets
+	int packet_count;
+	// number of samples per packet
+	int samples_per_packet;
+	// number of channels, bits per sample and components per sample
+	int nch;
+	int bps;
+	int cmp;
+	// shape and strides of exported buffer
+	Py_ssize_t shape[2];
+	Py_ssize_t strides[2];
+} SamplesObject;
+
+/* Copy of a VDIF header, read either as vdif_header_t or as
+ * vdif_r2dbe_header_t.
+ */
+typedef struct {
+	PyObject_HEAD
+	union {
+		vdif_header_t vdif;
+		vdif_r2dbe_header_t r2dbe;
+	} hdr;
+} HeaderObject;
+
+/* Reader over a flat file stream or a scatter-gather group.
+ */
+typedef struct {
+	PyObject_HEAD
+	// 1 if scatter-gather group, 0 if flat file stream
+	int is_sg;
+	// 1 while the files are open
+	int open;
+	// 1 while a read runs without the GIL
+	int busy;
+	// packet size in bytes
+	int packet_size;
+	// number of packets per batch when iterating
+	int batch_packets;
+	// underlying reader, depending on is_sg
+	FStream_t fstream;
+	SGGroup_t sggroup;
+} ReaderObject;
+
+static PyTypeObject BatchType;
+static PyTypeObject SamplesType;
+static PyTypeObject HeaderType;
+static PyTypeObject FlatFileType;
+static PyTypeObject SGGroupType;
+
+/* Fill a shape/strides pair and export a two-dimensional buffer.
+ * 
+ * Returns 0 on success, -1 with an exception set on failure.
+ */
+static int export_buffer(PyObject *obj, Py_buffer *view, int flags, void *data, Py_ssize_t *shape, Py_ssize_t *strides, Py_ssize_t itemsize, const char *format) {
+	if ((flags & PyBUF_WRITABLE) == PyBUF_WRITABLE) {
+		PyErr_SetString(PyExc_BufferError,"buffer is read-only");
+		view->obj = NULL;
+		return -1;
+	}
+	// an empty buffer still needs a valid address
+	view->buf = data != NULL ? data : (void *)view;
+	view->obj = obj;
+	Py_INCREF(obj);
+	view->len = shape[0]*shape[1]*itemsize;
+	view->readonly = 1;
+	view->itemsize = itemsize;
+	view->format = (flags & PyBUF_FORMAT) ? (char *)format : NULL;
+	view->ndim = 2;
+	view->shape = (flags & PyBUF_ND) == PyBUF_ND ? shape : NULL;
+	view->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? strides : NULL;
+	view->suboffsets = NULL;
+	view->internal = NULL;
+	return 0;
+}
+
+/* Return number of samples in the packet at hdr, or 0 if it is invalid
+ * or its frame length does not match packet_size, so that the payload
+ * can never extend past the packet.
+ */
+static int packet_samples(vdif_header_t *hdr, int packet_size) {
+	if (hdr->frame_length*8 != packet_size) {
+		return 0;
+	}
+	return count_samples(hdr);
+}
+
+/* Unpack count packets of packet_size bytes. Every packet gets the
+ * number of samples of the first valid packet, packets that are invalid
+ * or have a different layout or frame length get zero-filled samples.
+ * The GIL is released while samples are unpacked.
+ * 
+ * Returns new SamplesObject, or NULL with an exception set on failure.
+ */
+static PyObject *unpack_packets(const char *data, int packet_size, int packet_count) {
+	int ii;
+	int nch, bps, cmp;
+	uint32_t *samples;
+	vdif_header_t *hdr;
+	SamplesObject *obj;
+	
+	obj = PyObject_New(SamplesObject,&SamplesType);
+	if (obj == NULL) {
+		return NULL;
+	}
+	obj->data = NULL;
+	obj->packet_count = packet_count;
+	obj->samples_per_packet = 0;
+	obj->nch = 0;
+	obj->bps = 0;
+	obj->cmp = 0;
+	// all packets in a stream have the same layout, take the first valid
+	for (ii=0; ii<packet_count; ii++) {
+		hdr = (vdif_header_t *)(data + (size_t)ii*packet_size);
+		if ((obj->samples_per_packet = packet_samples(hdr,packet_size)) > 0) {
+			obj->nch = 0x01 << hdr->log2_chans;
+			obj->bps = hdr->bits_per_sample+1;
+			obj->cmp = hdr->complex ? 2 : 1;
+			break;
+		}
+	}
+	if (obj->samples_per_packet > 0) {
+		obj->data = (uint32_t *)memutils_alloc((size_t)obj->samples_per_packet*packet_count*sizeof(uint32_t));
+		if (obj->data == NULL) {
+			Py_DECREF(obj);
+			return PyErr_NoMemory();
+		}
+		Py_BEGIN_ALLOW_THREADS
+		for (ii=0; ii<packet_count; ii++) {
+			hdr = (vdif_header_t *)(data + (size_t)ii*packet_size);
+			samples = obj->data + (size_t)ii*obj->samples_per_packet;
+			if (packet_samples(hdr,packet_size) != obj->samples_per_packet) {
+				memset(samples,0,obj->samples_per_packet*sizeof(uint32_t));
+				continue;
+			}
+			get_samples_into(hdr,samples,&nch,&bps,&cmp);
+		}
+		Py_END_ALLOW_THREADS
+	}
+	obj->shape[0] = packet_count;
+	obj->shape[1] = obj->samples_per_packet;
+	obj->strides[0] = obj->samples_per_packet*sizeof(uint32_t);
+	obj->strides[1] = sizeof(uint32_t);
+	return (PyObject *)obj;
+}
+
+/* Return new HeaderObject holding a copy of the header at hdr.
+ */
+static PyObject *new_header(const void *hdr) {
+	HeaderObject *obj;
+	
+	obj = PyObject_New(HeaderObject,&HeaderType);
+	if (obj == NULL) {
+		return NULL;
+	}
+	memcpy(&obj->hdr,hdr,sizeof(obj->hdr));
+	return (PyObject *)obj;
+}
+
+/////////////////////////////////////////////////////////////////// BATCH
+
+static void Batch_dealloc(BatchObject *self) {
+	memutils_free(self->data);
+	PyObject_Free(self);
+}
+
+static int Batch_getbuffer(BatchObject *self, Py_buffer *view, int flags) {
+	return export_buffer((PyObject *)self,view,flags,self->data,self->shape,self->strides,1,"B");
+}
+
+static Py_ssize_t Batch_length(BatchObject *self) {
+	return self->packet_count;
+}
+
+static PyObject *Batch_header(BatchObject *self, PyObject *args) {
+	int index;
+	
+	if (!PyArg_ParseTuple(args,"i",&index)) {
+		return NULL;
+	}
+	if (index < 0) {
+		index += self->packet_count;
+	}
+	if (index < 0 || index >= self->packet_count) {
+		PyErr_SetString(PyExc_IndexError,"packet index out of range");
+		return NULL;
+	}
+	return new_header(self->data + (size_t)index*self->packet_size);
+}
+
+static PyObject *Batch_samples(BatchObject *self, PyObject *noargs) {
+	return unpack_packets(self->data,self->packet_size,self->packet_count);
+}
+
+static PyMethodDef Batch_methods[] = {
+	{"header",(PyCFunction)Batch_header,METH_VARARGS,
+	  "header(index) -- copy of the header of packet index"},
+	{"samples",(PyCFunction)Batch_samples,METH_NOARGS,
+	  "samples() -- unpack all packets, see vdif.get_samples"},
+	{NULL}
+};
+
+static PyMemberDef Batch_members[] = {
+	{"packet_size",T_INT,offsetof(BatchObject,packet_size),READONLY,"packet size in bytes"},
+	{"packet_count",T_INT,offsetof(BatchObject,packet_count),READONLY,"number of packets in batch"},
+	{NULL}
+};
+
+static PyBufferProcs Batch_as_buffer = {
+	(getbufferproc)Batch_getbuffer,
+	NULL,
+};
+
+static PySequenceMethods Batch_as_sequence = {
+	.sq_length = (lenfunc)Batch_length,
+};
+
+static PyTypeObject BatchType = {
+	PyVarObject_HEAD_INIT(NULL,0)
+	.tp_name = "vdif.Batch",
+	.tp_doc = "Batch of packets, exports a packet_count x packet_size byte buffer",
+	.tp_basicsize = sizeof(BatchObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_dealloc = (destructor)Batch_dealloc,
+	.tp_as_buffer = &Batch_as_buffer,
+	.tp_as_sequence = &Batch_as_sequence,
+	.tp_methods = Batch_methods,
+	.tp_members = Batch_members,
+};
+
+///////////////////////////////////////////////////////////////// SAMPLES
+
+static void Samples_dealloc(SamplesObject *self) {
+	memutils_free(self->data);
+	PyObject_Free(self);
+}
+
+static int Samples_getbuffer(SamplesObject *self, Py_buffer *view, int flags) {
+	return export_buffer((PyObject *)self,view,flags,self->data,self->shape,self->strides,sizeof(uint32_t),"I");
+}
+
+static PyMemberDef Samples_members[] = {
+	{"packet_count",T_INT,offsetof(SamplesObject,packet_count),READONLY,"number of packets"},
+	{"samples_per_packet",T_INT,offsetof(SamplesObject,samples_per_packet),READONLY,"number of samples per packet"},
+	{"nch",T_INT,offsetof(SamplesObject,nch),READONLY,"number of channels"},
+	{"bps",T_INT,offsetof(SamplesObject,bps),READONLY,"number of bits per sample"},
+	{"cmp",T_INT,offsetof(SamplesObject,cmp),READONLY,"number of components per sample (1 real, 2 complex)"},
+	{NULL}
+};
+
+static PyBufferProcs Samples_as_buffer = {
+	(getbufferproc)Samples_getbuffer,
+	NULL,
+};
+
+static PyTypeObject SamplesType = {
+	PyVarObject_HEAD_INIT(NULL,0)
+	.tp_name = "vdif.Samples",
+	.tp_doc = "Unpacked samples, exports a packet_count x samples_per_packet uint32 buffer",
+	.tp_basicsize = sizeof(SamplesObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_dealloc = (destructor)Samples_dealloc,
+	.tp_as_buffer = &Samples_as_buffer,
+	.tp_members = Samples_members,
+};
+
+////////////////////////////////////////////////////////////////// HEADER
+
+// getter for a field of vdif_header_t or vdif_r2dbe_header_t
+#define HEADER_FIELD(name,view) \
+static PyObject *Header_get_##name(HeaderObject *self, void *closure) { \
+	return PyLong_FromUnsignedLong(self->hdr.view.name); \
+}
+
+HEADER_FIELD(secs_since_epoch,vdif)
+HEADER_FIELD(legacy_mode,vdif)
+HEADER_FIELD(invalid_data,vdif)
+HEADER_FIELD(data_frame,vdif)
+HEADER_FIELD(ref_epoch,vdif)
+HEADER_FIELD(frame_length,vdif)
+HEADER_FIELD(log2_chans,vdif)
+HEADER_FIELD(vdif_vers,vdif)
+HEADER_FIELD(station_id,vdif)
+HEADER_FIELD(thread_id,vdif)
+HEADER_FIELD(bits_per_sample,vdif)
+HEADER_FIELD(complex,vdif)
+HEADER_FIELD(eud0,vdif)
+HEADER_FIELD(edv,vdif)
+HEADER_FIELD(eud1,vdif)
+HEADER_FIELD(eud2,vdif)
+HEADER_FIELD(eud3,vdif)
+HEADER_FIELD(pol_rcp_not_lcp,r2dbe)
+HEADER_FIELD(bdc_hi_not_lo,r2dbe)
+HEADER_FIELD(rec_hi_not_lo,r2dbe)
+HEADER_FIELD(pps_offset,r2dbe)
+
+static PyObject *Header_get_psn(HeaderObject *self, void *closure) {
+	return PyLong_FromUnsignedLongLong(psn64(&self->hdr.r2dbe));
+}
+
+static PyObject *Header_get_pps_offset_time(HeaderObject *self, void *closure) {
+	return PyFloat_FromDouble(pps_offset_time(&self->hdr.r2dbe));
+}
+
+static PyObject *Header_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	PyObject *obj;
+	Py_buffer view;
+	
+	if (!PyArg_ParseTuple(args,"y*",&view)) {
+		return NULL;
+	}
+	if (view.len < (Py_ssize_t)sizeof(vdif_header_t)) {
+		PyBuffer_Release(&view);
+		PyErr_Format(PyExc_ValueError,"need at least %d bytes",(int)sizeof(vdif_header_t));
+		return NULL;
+	}
+	obj = new_header(view.buf);
+	PyBuffer_Release(&view);
+	return obj;
+}
+
+static PyObject *Header_repr(HeaderObject *self) {
+	return PyUnicode_FromFormat("<vdif.Header %u@%u+%u thread %u station 0x%04x%s>",
+	  (unsigned)self->hdr.vdif.ref_epoch,(unsigned)self->hdr.vdif.secs_since_epoch,
+	  (unsigned)self->hdr.vdif.data_frame,(unsigned)self->hdr.vdif.thread_id,
+	  (unsigned)self->hdr.vdif.station_id,self->hdr.vdif.invalid_data ? " invalid" : "");
+}
+
+#define HEADER_GETSET(name,doc) {#name,(getter)Header_get_##name,NULL,doc,NULL}
+
+static PyGetSetDef Header_getset[] = {
+	HEADER_GETSET(secs_since_epoch,"seconds since reference epoch"),
+	HEADER_GETSET(legacy_mode,"1 if legacy header"),
+	HEADER_GETSET(invalid_data,"1 if data is marked invalid"),
+	HEADER_GETSET(data_frame,"data frame number within second"),
+	HEADER_GETSET(ref_epoch,"reference epoch, half-years since 2000"),
+	HEADER_GETSET(frame_length,"frame length in units of 8 bytes"),
+	HEADER_GETSET(log2_chans,"log2 of number of channels"),
+	HEADER_GETSET(vdif_vers,"VDIF version"),
+	HEADER_GETSET(station_id,"station identifier"),
+	HEADER_GETSET(thread_id,"thread identifier"),
+	HEADER_GETSET(bits_per_sample,"bits per sample minus one, as stored"),
+	HEADER_GETSET(complex,"1 if complex data"),
+	HEADER_GETSET(eud0,"extended user data word 4"),
+	HEADER_GETSET(edv,"extended data version"),
+	HEADER_GETSET(eud1,"extended user data word 5"),
+	HEADER_GETSET(eud2,"extended user data word 6"),
+	HEADER_GETSET(eud3,"extended user data word 7"),
+	HEADER_GETSET(pol_rcp_not_lcp,"R2DBE: 1 if RCP, 0 if LCP"),
+	HEADER_GETSET(bdc_hi_not_lo,"R2DBE: 1 if BDC high band"),
+	HEADER_GETSET(rec_hi_not_lo,"R2DBE: 1 if receiver high band"),
+	HEADER_GETSET(pps_offset,"R2DBE: PPS offset in FPGA clock cycles"),
+	HEADER_GETSET(psn,"R2DBE: packet serial number"),
+	HEADER_GETSET(pps_offset_time,"R2DBE: PPS offset in seconds"),
+	{NULL}
+};
+
+static PyTypeObject HeaderType = {
+	PyVarObject_HEAD_INIT(NULL,0)
+	.tp_name = "vdif.Header",
+	.tp_doc = "Header(buffer) -- copy of the VDIF header at the start of buffer",
+	.tp_basicsize = sizeof(HeaderObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = Header_new,
+	.tp_repr = (reprfunc)Header_repr,
+	.tp_getset = Header_getset,
+};
+
+///////////////////////////////////////////////////////////////// READERS
+
+static void Reader_close_files(ReaderObject *self) {
+	if (!self->open) {
+		return;
+	}
+	if (self->is_sg) {
+		close_group_sg(&self->sggroup);
+	} else {
+		close_stream_f(&self->fstream);
+	}
+	self->open = 0;
+}
+
+static void Reader_dealloc(ReaderObject *self) {
+	Reader_close_files(self);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+/* Convert sequence of file names to a C array.
+ * 
+ * Returns array of borrowed UTF-8 strings, to be released with
+ * PyMem_Free, or NULL with an exception set on failure.
+ */
+static const char **filename_array(PyObject *args, int *num_files) {
+	int ii;
+	const char **filenames;
+	
+	*num_files = (int)PyTuple_GET_SIZE(args);
+	if (*num_files == 0) {
+		PyErr_SetString(PyExc_TypeError,"need at least one file name");
+		return NULL;
+	}
+	filenames = PyMem_Malloc(*num_files*sizeof(char *));
+	if (filenames == NULL) {
+		PyErr_NoMemory();
+		return NULL;
+	}
+	for (ii=0; ii<*num_files; ii++) {
+		filenames[ii] = PyUnicode_AsUTF8(PyTuple_GET_ITEM(args,ii));
+		if (filenames[ii] == NULL) {
+			PyMem_Free(filenames);
+			return NULL;
+		}
+	}
+	return filenames;
+}
+
+static int Reader_init(ReaderObject *self, PyObject *args, PyObject *kwds, int is_sg) {
+	int rv;
+	int num_files;
+	int streaming = 0;
+	int batch_packets = VDIFMODULE_BATCH_PACKETS;
+	PyObject *empty;
+	const char **filenames;
+	static char *kwlist[] = {"batch_packets","streaming",NULL};
+	
+	// file names are positional, options are keyword-only
+	empty = PyTuple_New(0);
+	if (empty == NULL) {
+		return -1;
+	}
+	rv = PyArg_ParseTupleAndKeywords(empty,kwds,"|ip",kwlist,&batch_packets,&streaming);
+	Py_DECREF(empty);
+	if (!rv) {
+		return -1;
+	}
+	if (batch_packets < 1) {
+		PyErr_SetString(PyExc_ValueError,"batch_packets should be positive");
+		return -1;
+	}
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError,"reader is in use by another thread");
+		return -1;
+	}
+	filenames = filename_array(args,&num_files);
+	if (filenames == NULL) {
+		return -1;
+	}
+	Reader_close_files(self);
+	self->is_sg = is_sg;
+	self->batch_packets = batch_packets;
+	self->busy = 1;
+	Py_BEGIN_ALLOW_THREADS
+	if (is_sg) {
+		rv = open_group_sg(num_files,filenames,&self->sggroup);
+	} else {
+		rv = open_stream_f(num_files,filenames,&self->fstream);
+	}
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+	PyMem_Free(filenames);
+	if (rv == -1) {
+		PyErr_SetString(PyExc_OSError,"unable to open files, see stderr for details");
+		return -1;
+	}
+	self->open = 1;
+	if (is_sg) {
+		self->packet_size = self->sggroup.packet_size;
+		set_streaming_group_sg(&self->sggroup,streaming);
+	} else {
+		self->packet_size = self->fstream.packet_size;
+		set_streaming_stream_f(&self->fstream,streaming);
+	}
+	return 0;
+}
+
+static int FlatFile_init(ReaderObject *self, PyObject *args, PyObject *kwds) {
+	return Reader_init(self,args,kwds,0);
+}
+
+static int SGGroup_init(ReaderObject *self, PyObject *args, PyObject *kwds) {
+	return Reader_init(self,args,kwds,1);
+}
+
+/* Read up to num_packets packets into a new batch. The GIL is released
+ * while reading.
+ * 
+ * Returns new BatchObject, Py_None at end of data, or NULL with an
+ * exception set on failure.
+ */
+static PyObject *Reader_read_batch(ReaderObject *self, int num_packets) {
+	int rv;
+	BatchObject *batch;
+	
+	if (!self->open) {
+		PyErr_SetString(PyExc_ValueError,"I/O operation on closed reader");
+		return NULL;
+	}
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError,"reader is in use by another thread");
+		return NULL;
+	}
+	batch = PyObject_New(BatchObject,&BatchType);
+	if (batch == NULL) {
+		return NULL;
+	}
+	batch->packet_size = self->packet_size;
+	batch->packet_count = 0;
+	batch->data = (char *)memutils_alloc((size_t)num_packets*self->packet_size);
+	if (batch->data == NULL) {
+		Py_DECREF(batch);
+		return PyErr_NoMemory();
+	}
+	self->busy = 1;
+	Py_BEGIN_ALLOW_THREADS
+	if (self->is_sg) {
+		rv = read_packets_into_group_sg(&self->sggroup,num_packets,batch->data);
+	} else {
+		rv = read_packets_into_stream_f(&self->fstream,num_packets,batch->data);
+	}
+	Py_END_ALLOW_THREADS
+	self->busy = 0;
+	if (rv == -1) {
+		Py_DECREF(batch);
+		PyErr_SetString(PyExc_OSError,"read failed, see stderr for details");
+		return NULL;
+	}
+	if (rv == 0) {
+		Py_DECREF(batch);
+		Py_RETURN_NONE;
+	}
+	batch->packet_count = rv;
+	batch->shape[0] = rv;
+	batch->shape[1] = self->packet_size;
+	batch->strides[0] = self->packet_size;
+	batch->strides[1] = 1;
+	return (PyObject *)batch;
+}
+
+static PyObject *Reader_read(ReaderObject *self, PyObject *args) {
+	int num_packets;
+	
+	num_packets = self->batch_packets;
+	if (!PyArg_ParseTuple(args,"|i",&num_packets)) {
+		return NULL;
+	}
+	if (num_packets < 1) {
+		PyErr_SetString(PyExc_ValueError,"number of packets should be positive");
+		return NULL;
+	}
+	return Reader_read_batch(self,num_packets);
+}
+
+static PyObject *Reader_iternext(ReaderObject *self) {
+	PyObject *batch;
+	
+	batch = Reader_read_batch(self,self->batch_packets);
+	if (batch == Py_None) {
+		// returning NULL without exception set ends iteration
+		Py_DECREF(batch);
+		return NULL;
+	}
+	return batch;
+}
+
+static PyObject *Reader_close(ReaderObject *self, PyObject *noargs) {
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError,"reader is in use by another thread");
+		return NULL;
+	}
+	Reader_close_files(self);
+	Py_RETURN_NONE;
+}
+
+static PyObject *Reader_enter(ReaderObject *self, PyObject *noargs) {
+	Py_INCREF(self);
+	return (PyObject *)self;
+}
+
+static PyObject *Reader_exit(ReaderObject *self, PyObject *args) {
+	return Reader_close(self,NULL);
+}
+
+static PyObject *Reader_set_streaming(ReaderObject *self, PyObject *args) {
+	int enable;
+	
+	if (!PyArg_ParseTuple(args,"p",&enable)) {
+		return NULL;
+	}
+	if (!self->open) {
+		PyErr_SetString(PyExc_ValueError,"I/O operation on closed reader");
+		return NULL;
+	}
+	if (self->busy) {
+		PyErr_SetString(PyExc_RuntimeError,"reader is in use by another thread");
+		return NULL;
+	}
+	if (self->is_sg) {
+		set_streaming_group_sg(&self->sggroup,enable);
+	} else {
+		set_streaming_stream_f(&self->fstream,enable);
+	}
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef Reader_methods[] = {
+	{"read",(PyCFunction)Reader_read,METH_VARARGS,
+	  "read([num_packets]) -- read up to num_packets packets (default batch_packets)\n"
+	  "into a new Batch, returns None at end of data"},
+	{"set_streaming",(PyCFunction)Reader_set_streaming,METH_VARARGS,
+	  "set_streaming(enable) -- enable or disable page-cache streaming mode"},
+	{"close",(PyCFunction)Reader_close,METH_NOARGS,"close() -- close the files"},
+	{"__enter__",(PyCFunction)Reader_enter,METH_NOARGS,NULL},
+	{"__exit__",(PyCFunction)Reader_exit,METH_VARARGS,NULL},
+	{NULL}
+};
+
+static PyMemberDef Reader_members[] = {
+	{"packet_size",T_INT,offsetof(ReaderObject,packet_size),READONLY,"packet size in bytes"},
+	{NULL}
+};
+
+static PyObject *Reader_get_batch_packets(ReaderObject *self, void *closure) {
+	return PyLong_FromLong(self->batch_packets);
+}
+
+static int Reader_set_batch_packets(ReaderObject *self, PyObject *value, void *closure) {
+	long batch_packets;
+	
+	if (value == NULL) {
+		PyErr_SetString(PyExc_TypeError,"cannot delete batch_packets");
+		return -1;
+	}
+	batch_packets = PyLong_AsLong(value);
+	if (batch_packets == -1 && PyErr_Occurred()) {
+		return -1;
+	}
+	if (batch_packets < 1 || batch_packets > INT_MAX) {
+		PyErr_SetString(PyExc_ValueError,"batch_packets should be positive");
+		return -1;
+	}
+	self->batch_packets = (int)batch_packets;
+	return 0;
+}
+
+static PyGetSetDef Reader_getset[] = {
+	{"batch_packets",(getter)Reader_get_batch_packets,(setter)Reader_set_batch_packets,
+	  "number of packets per batch when iterating",NULL},
+	{NULL}
+};
+
+static PyTypeObject FlatFileType = {
+	PyVarObject_HEAD_INIT(NULL,0)
+	.tp_name = "vdif.FlatFile",
+	.tp_doc = "FlatFile(filename, ..., batch_packets=65536, streaming=False)\n"
+	  "Reader over one or more flat VDIF files, read as a single stream.\n"
+	  "Iterating yields Batch objects of batch_packets packets.",
+	.tp_basicsize = sizeof(ReaderObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = PyType_GenericNew,
+	.tp_init = (initproc)FlatFile_init,
+	.tp_dealloc = (destructor)Reader_dealloc,
+	.tp_iter = PyObject_SelfIter,
+	.tp_iternext = (iternextfunc)Reader_iternext,
+	.tp_methods = Reader_methods,
+	.tp_members = Reader_members,
+	.tp_getset = Reader_getset,
+};
+
+static PyTypeObject SGGroupType = {
+	PyVarObject_HEAD_INIT(NULL,0)
+	.tp_name = "vdif.SGGroup",
+	.tp_doc = "SGGroup(filename, ..., batch_packets=65536, streaming=False)\n"
+	  "Reader over a group of scatter-gather files.\n"
+	  "Iterating yields Batch objects of batch_packets packets.",
+	.tp_basicsize = sizeof(ReaderObject),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = PyType_GenericNew,
+	.tp_init = (initproc)SGGroup_init,
+	.tp_dealloc = (destructor)Reader_dealloc,
+	.tp_iter = PyObject_SelfIter,
+	.tp_iternext = (iternextfunc)Reader_iternext,
+	.tp_methods = Reader_methods,
+	.tp_members = Reader_members,
+	.tp_getset = Reader_getset,
+};
+
+////////////////////////////////////////////////////////////////// MODULE
+
+static PyObject *vdif_get_samples(PyObject *module, PyObject *args) {
+	int packet_size = 0;
+	PyObject *samples;
+	Py_buffer view;
+	
+	if (!PyArg_ParseTuple(args,"y*|i",&view,&packet_size)) {
+		return NULL;
+	}
+	if (view.len < (Py_ssize_t)sizeof(vdif_header_t)) {
+		PyBuffer_Release(&view);
+		PyErr_Format(PyExc_ValueError,"need at least %d bytes",(int)sizeof(vdif_header_t));
+		return NULL;
+	}
+	if (packet_size == 0) {
+		packet_size = ((vdif_header_t *)view.buf)->frame_length*8;
+	} else if (packet_size != ((vdif_header_t *)view.buf)->frame_length*8) {
+		PyBuffer_Release(&view);
+		PyErr_Format(PyExc_ValueError,"packet size %d does not match frame length %d of first packet",
+		  packet_size,((vdif_header_t *)view.buf)->frame_length*8);
+		return NULL;
+	}
+	if (packet_size < (int)sizeof(vdif_header_t) || view.len % packet_size != 0) {
+		PyBuffer_Release(&view);
+		PyErr_Format(PyExc_ValueError,"buffer length %zd is not a multiple of packet size %d",view.len,packet_size);
+		return NULL;
+	}
+	samples = unpack_packets((const char *)view.buf,packet_size,(int)(view.len/packet_size));
+	PyBuffer_Release(&view);
+	return samples;
+}
+
+static PyObject *vdif_is_file_sg(PyObject *module, PyObject *args) {
+	const char *filename;
+	
+	if (!PyArg_ParseTuple(args,"s",&filename)) {
+		return NULL;
+	}
+	return PyBool_FromLong(is_file_sg(filename));
+}
+
+static PyObject *vdif_set_memory_policy(PyObject *module, PyObject *args, PyObject *kwds) {
+	int huge_pages = 0;
+	int numa_node = MEMUTILS_NODE_ANY;
+	static char *kwlist[] = {"huge_pages","numa_node",NULL};
+	
+	if (!PyArg_ParseTupleAndKeywords(args,kwds,"|pi",kwlist,&huge_pages,&numa_node)) {
+		return NULL;
+	}
+	memutils_set_policy(huge_pages ? MEMUTILS_HUGE_PAGES : 0,numa_node);
+	Py_RETURN_NONE;
+}
+
+static PyMethodDef vdif_methods[] = {
+	{"get_samples",(PyCFunction)vdif_get_samples,METH_VARARGS,
+	  "get_samples(buffer[, packet_size]) -- unpack the packets in buffer into a new\n"
+	  "Samples object. The packet size defaults to the frame length of the first\n"
+	  "packet, and should match it if given. Invalid packets get zero-filled samples."},
+	{"is_file_sg",(PyCFunction)vdif_is_file_sg,METH_VARARGS,
+	  "is_file_sg(filename) -- True if the file starts with a scatter-gather header"},
+	{"set_memory_policy",(PyCFunction)vdif_set_memory_policy,METH_VARARGS|METH_KEYWORDS,
+	  "set_memory_policy(huge_pages=False, numa_node=-1) -- allocation policy for\n"
+	  "batch and sample buffers"},
+	{NULL}
+};
+
+static struct PyModuleDef vdif_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "vdif",
+	.m_doc = "Read VDIF flat files and scatter-gather groups in batches. Batch and Samples\n"
+	  "objects export their buffers without copying, e.g. numpy.asarray(batch).",
+	.m_size = -1,
+	.m_methods = vdif_methods,
+};
+
+PyMODINIT_FUNC PyInit_vdif(void) {
+	int ii;
+	PyObject *module;
+	PyTypeObject *types[] = {&BatchType,&SamplesType,&HeaderType,&FlatFileType,&SGGroupType};
+	const char *names[] = {"Batch","Samples","Header","FlatFile","SGGroup"};
+	
+	for (ii=0; ii<5; ii++) {
+		if (PyType_Ready(types[ii]) < 0) {
+			return NULL;
+		}
+	}
+	module = PyModule_Create(&vdif_module);
+	if (module == NULL) {
+		return NULL;
+	}
+	for (ii=0; ii<5; ii++) {
+		Py_INCREF(types[ii]);
+		if (PyModule_AddObject(module,names[ii],(PyObject *)types[ii]) < 0) {
+			Py_DECREF(types[ii]);
+			Py_DECREF(module);
+			return NULL;
+		}
+	}
+	return module;
+}
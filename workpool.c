@@ -0,0 +1,369 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "memutils.h"
+#include "workpool.h"
+
+/////////////////////////////////////////////////// INTERNAL DEFINITIONS
+
+// initial number of jobs each deque can hold
+#define WORKPOOL_DEQUE_CAPACITY 64
+
+/* Add devices that are not yet in the device table. Should be called
+ * with the pool lock held.
+ * 
+ * Returns 1 on success, -1 on failure.
+ */
+static int register_devices(WorkPool_t *pool, int device_count, const dev_t *devices) {
+	int ii, jj;
+	int capacity;
+	WPDevice_t *tmp;
+	
+	if (pool->device_limit <= 0) {
+		return 1;
+	}
+	for (ii=0; ii<device_count; ii++) {
+		if (devices[ii] == 0) {
+			continue;
+		}
+		for (jj=0; jj<pool->device_count; jj++) {
+			if (pool->devices[jj].device == devices[ii]) {
+				break;
+			}
+		}
+		if (jj < pool->device_count) {
+			continue;
+		}
+		if (pool->device_count == pool->device_capacity) {
+			capacity = pool->device_capacity > 0 ? 2*pool->device_capacity : 16;
+			tmp = (WPDevice_t *)realloc(pool->devices,capacity*sizeof(WPDevice_t));
+			if (tmp == NULL) {
+				return -1;
+			}
+			pool->devices = tmp;
+			pool->device_capacity = capacity;
+		}
+		pool->devices[jj].device = devices[ii];
+		pool->devices[jj].active = 0;
+		pool->device_count++;
+	}
+	return 1;
+}
+
+/* Try to reserve all devices of a job. Should be called with the pool
+ * lock held, and the devices should have been registered when the job
+ * was submitted.
+ * 
+ * Returns 1 if all devices were reserved, 0 if any is at its limit.
+ */
+static int acquire_devices(WorkPool_t *pool, const WPJob_t *job) {
+	int ii, jj;
+	
+	if (pool->device_limit <= 0) {
+		return 1;
+	}
+	// check limits
+	for (ii=0; ii<job->device_count; ii++) {
+		for (jj=0; jj<pool->device_count; jj++) {
+			if (pool->devices[jj].device == job->devices[ii]) {
+				break;
+			}
+		}
+		if (jj < pool->device_count && pool->devices[jj].active >= pool->device_limit) {
+			return 0;
+		}
+	}
+	// all devices available, reserve them
+	for (ii=0; ii<job->device_count; ii++) {
+		for (jj=0; jj<pool->device_count; jj++) {
+			if (pool->devices[jj].device == job->devices[ii]) {
+				pool->devices[jj].active++;
+				break;
+			}
+		}
+	}
+	return 1;
+}
+
+/* Release all devices of a job. Should be called with the pool lock
+ * held.
+ */
+static void release_devices(WorkPool_t *pool, const WPJob_t *job) {
+	int ii, jj;
+	
+	if (pool->device_limit <= 0) {
+		return;
+	}
+	for (ii=0; ii<job->device_count; ii++) {
+		for (jj=0; jj<pool->device_count; jj++) {
+			if (pool->devices[jj].device == job->devices[ii]) {
+				pool->devices[jj].active--;
+				break;
+			}
+		}
+	}
+}
+
+/* Take the first runnable job from deque, scanning from the tail if
+ * from_tail is set, and from the head otherwise.
+ * 
+ * Returns 1 if a job was taken, 0 otherwise.
+ */
+static int take_from_deque(WorkPool_t *pool, WPDeque_t *deque, int from_tail, WPJob_t *job) {
+	int ii, kk;
+	int pos, next;
+	int found = 0;
+	
+	pthread_mutex_lock(&deque->lock);
+	for (ii=0; ii<deque->count && !found; ii++) {
+		kk = from_tail ? deque->count-1-ii : ii;
+		pos = (deque->head + kk) % deque->capacity;
+		pthread_mutex_lock(&pool->lock);
+		found = acquire_devices(pool,&deque->jobs[pos]);
+		pthread_mutex_unlock(&pool->lock);
+		if (!found) {
+			continue;
+		}
+		*job = deque->jobs[pos];
+		// close the gap left by the job
+		for (; kk<deque->count-1; kk++) {
+			next = (pos + 1) % deque->capacity;
+			deque->jobs[pos] = deque->jobs[next];
+			pos = next;
+		}
+		deque->count--;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+/* Take a runnable job, first from the worker's own deque, then by
+ * stealing from the other workers.
+ * 
+ * Returns 1 if a job was taken, 0 otherwise.
+ */
+static int take_job(WorkPool_t *pool, int index, WPJob_t *job) {
+	int ii;
+	
+	for (ii=0; ii<pool->thread_count; ii++) {
+		if (take_from_deque(pool,&pool->deques[(index+ii) % pool->thread_count],ii==0,job)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Thread body for every worker.
+ */
+static void *run_worker(void *arg) {
+	int index;
+	unsigned long generation;
+	WorkPool_t *pool = (WorkPool_t *)arg;
+	WPJob_t job;
+	
+	pthread_mutex_lock(&pool->lock);
+	index = pool->started++;
+	pthread_mutex_unlock(&pool->lock);
+	memutils_bind_thread(memutils_numa_node());
+	while (1) {
+		pthread_mutex_lock(&pool->lock);
+		generation = pool->generation;
+		pthread_mutex_unlock(&pool->lock);
+		if (take_job(pool,index,&job)) {
+			job.func(job.arg);
+			pthread_mutex_lock(&pool->lock);
+			release_devices(pool,&job);
+			pool->pending--;
+			pool->generation++;
+			pthread_cond_broadcast(&pool->changed);
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+		// nothing runnable, wait for a job or device to become available
+		pthread_mutex_lock(&pool->lock);
+		while (generation == pool->generation && !(pool->shutdown && pool->pending == 0)) {
+			pthread_cond_wait(&pool->changed,&pool->lock);
+		}
+		if (pool->shutdown && pool->pending == 0) {
+			pthread_mutex_unlock(&pool->lock);
+			break;
+		}
+		pthread_mutex_unlock(&pool->lock);
+	}
+	return NULL;
+}
+
+///////////////////////////////////////////////////////////////// POOL
+
+int workpool_init(WorkPool_t *pool, int thread_count, int device_limit) {
+	int ii;
+	
+	memset(pool,0,sizeof(WorkPool_t));
+	pthread_mutex_init(&pool->lock,NULL);
+	pthread_cond_init(&pool->changed,NULL);
+	pool->device_limit = device_limit;
+	pool->threads = (pthread_t *)calloc(thread_count,sizeof(pthread_t));
+	pool->deques = (WPDeque_t *)calloc(thread_count,sizeof(WPDeque_t));
+	if (pool->threads == NULL || pool->deques == NULL) {
+		free(pool->threads);
+		free(pool->deques);
+		pthread_mutex_destroy(&pool->lock);
+		pthread_cond_destroy(&pool->changed);
+		return -1;
+	}
+	for (ii=0; ii<thread_count; ii++) {
+		pool->deques[ii].jobs = (WPJob_t *)malloc(WORKPOOL_DEQUE_CAPACITY*sizeof(WPJob_t));
+		if (pool->deques[ii].jobs == NULL) {
+			fprintf(stderr,
+			  "%s.%s(%d): unable to allocate job deque\n",
+			  __FILE__,__FUNCTION__,__LINE__);
+			// unwind the deques that were set up
+			for (; ii>0; ii--) {
+				free(pool->deques[ii-1].jobs);
+				pthread_mutex_destroy(&pool->deques[ii-1].lock);
+			}
+			free(pool->threads);
+			free(pool->deques);
+			pool->threads = NULL;
+			pool->deques = NULL;
+			pthread_mutex_destroy(&pool->lock);
+			pthread_cond_destroy(&pool->changed);
+			return -1;
+		}
+		pthread_mutex_init(&pool->deques[ii].lock,NULL);
+		pool->deques[ii].capacity = WORKPOOL_DEQUE_CAPACITY;
+	}
+	// workers index deques modulo thread_count, so set it before start
+	pool->thread_count = thread_count;
+	for (ii=0; ii<thread_count; ii++) {
+		if ((errno = pthread_create(&pool->threads[ii],NULL,run_worker,pool)) != 0) {
+			perror("workpool.c.workpool_init(): ");
+			// stop and join the workers that did start
+			pthread_mutex_lock(&pool->lock);
+			pool->shutdown = 1;
+			pthread_cond_broadcast(&pool->changed);
+			pthread_mutex_unlock(&pool->lock);
+			for (; ii>0; ii--) {
+				pthread_join(pool->threads[ii-1],NULL);
+			}
+			for (ii=0; ii<thread_count; ii++) {
+				free(pool->deques[ii].jobs);
+			}
+			pool->thread_count = 0;
+			workpool_destroy(pool);
+			return -1;
+		}
+	}
+	return 1;
+}
+
+int workpool_submit(WorkPool_t *pool, WPJobFunc_t func, void *arg, int device_count, const dev_t *devices) {
+	int ii;
+	WPDeque_t *deque;
+	WPJob_t *tmp;
+	
+	if (device_count > WORKPOOL_MAX_JOB_DEVICES) {
+		fprintf(stderr,
+		  "%s.%s(%d): job uses %d devices, maximum is %d\n",
+		  __FILE__,__FUNCTION__,__LINE__,
+		  device_count,WORKPOOL_MAX_JOB_DEVICES);
+		return -1;
+	}
+	pthread_mutex_lock(&pool->lock);
+	if (register_devices(pool,device_count,devices) == -1) {
+		pthread_mutex_unlock(&pool->lock);
+		fprintf(stderr,
+		  "%s.%s(%d): unable to grow device table\n",
+		  __FILE__,__FUNCTION__,__LINE__);
+		return -1;
+	}
+	deque = &pool->deques[pool->next_deque];
+	pool->next_deque = (pool->next_deque + 1) % pool->thread_count;
+	pool->pending++;
+	pthread_mutex_unlock(&pool->lock);
+	pthread_mutex_lock(&deque->lock);
+	if (deque->count == deque->capacity) {
+		// unroll ring into a larger buffer
+		tmp = (WPJob_t *)malloc(2*deque->capacity*sizeof(WPJob_t));
+		if (tmp == NULL) {
+			pthread_mutex_unlock(&deque->lock);
+			pthread_mutex_lock(&pool->lock);
+			pool->pending--;
+			pthread_mutex_unlock(&pool->lock);
+			return -1;
+		}
+		for (ii=0; ii<deque->count; ii++) {
+			tmp[ii] = deque->jobs[(deque->head + ii) % deque->capacity];
+		}
+		free(deque->jobs);
+		deque->jobs = tmp;
+		deque->head = 0;
+		deque->capacity *= 2;
+	}
+	tmp = &deque->jobs[(deque->head + deque->count) % deque->capacity];
+	tmp->func = func;
+	tmp->arg = arg;
+	tmp->device_count = device_count;
+	for (ii=0; ii<device_count; ii++) {
+		tmp->devices[ii] = devices[ii];
+	}
+	deque->count++;
+	pthread_mutex_unlock(&deque->lock);
+	pthread_mutex_lock(&pool->lock);
+	pool->generation++;
+	pthread_cond_broadcast(&pool->changed);
+	pthread_mutex_unlock(&pool->lock);
+	return 1;
+}
+
+void workpool_wait(WorkPool_t *pool) {
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending > 0) {
+		pthread_cond_wait(&pool->changed,&pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void workpool_destroy(WorkPool_t *pool) {
+	int ii;
+	
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->changed);
+	pthread_mutex_unlock(&pool->lock);
+	for (ii=0; ii<pool->thread_count; ii++) {
+		pthread_join(pool->threads[ii],NULL);
+	}
+	if (pool->deques != NULL) {
+		for (ii=0; ii<pool->thread_count; ii++) {
+			free(pool->deques[ii].jobs);
+			pthread_mutex_destroy(&pool->deques[ii].lock);
+		}
+		free(pool->deques);
+		pool->deques = NULL;
+	}
+	if (pool->threads != NULL) {
+		free(pool->threads);
+		pool->threads = NULL;
+	}
+	if (pool->devices != NULL) {
+		free(pool->devices);
+		pool->devices = NULL;
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->changed);
+	pool->thread_count = 0;
+}
+
+dev_t workpool_device(const char *filename) {
+	struct stat st;
+	
+	if (stat(filename,&st) == -1) {
+		return 0;
+	}
+	return st.st_dev;
+}
@@ -0,0 +1,116 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+/* Maximum number of devices a single job can be tied to.
+ */
+#define WORKPOOL_MAX_JOB_DEVICES 64
+
+/* Job function, called once on one of the pool threads.
+ */
+typedef void (*WPJobFunc_t)(void *arg);
+
+/* Encapsulates a job and the devices it does I/O on.
+ */
+typedef struct WPJob {
+	// job function and its argument
+	WPJobFunc_t func;
+	void *arg;
+	// number of devices in list
+	int device_count;
+	// devices the job does I/O on
+	dev_t devices[WORKPOOL_MAX_JOB_DEVICES];
+} WPJob_t;
+
+/* Double-ended queue of jobs owned by one worker. The owner takes jobs
+ * from the tail, other workers steal from the head.
+ */
+typedef struct WPDeque {
+	// ring of jobs
+	WPJob_t *jobs;
+	// allocated number of jobs in ring
+	int capacity;
+	// index of first job in ring
+	int head;
+	// number of jobs in ring
+	int count;
+	// protects the deque
+	pthread_mutex_t lock;
+} WPDeque_t;
+
+/* Number of jobs active on a device.
+ */
+typedef struct WPDevice {
+	// device identifier as returned by stat
+	dev_t device;
+	// number of jobs currently doing I/O on device
+	int active;
+} WPDevice_t;
+
+/* Encapsulates a work-stealing thread pool. Jobs are distributed over
+ * per-worker deques, and idle workers steal from the others. Jobs tied
+ * to devices only start when none of their devices already has
+ * device_limit active jobs, so that concurrent I/O is spread across
+ * physical devices instead of piling onto one.
+ */
+typedef struct WorkPool {
+	// worker threads
+	pthread_t *threads;
+	// number of worker threads
+	int thread_count;
+	// one deque per worker
+	WPDeque_t *deques;
+	// deque that receives the next submitted job
+	int next_deque;
+	// maximum number of concurrent jobs per device, 0 for no limit
+	int device_limit;
+	// table of devices seen in jobs
+	WPDevice_t *devices;
+	// number of devices in table, and allocated size
+	int device_count;
+	int device_capacity;
+	// number of workers started, used to assign deques to workers
+	int started;
+	// number of jobs submitted and not yet finished
+	int pending;
+	// incremented on every change that may make a job runnable
+	unsigned long generation;
+	// set to stop workers
+	int shutdown;
+	// protects devices, started, pending, generation and shutdown
+	pthread_mutex_t lock;
+	// signalled when jobs are submitted, finished, or devices released
+	pthread_cond_t changed;
+} WorkPool_t;
+
+/* Start a pool of thread_count workers, which allows at most
+ * device_limit concurrent jobs per device (0 for no limit).
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int workpool_init(WorkPool_t *pool, int thread_count, int device_limit);
+
+/* Submit a job that does I/O on the listed devices (device_count can be
+ * 0 for jobs that are not tied to a device).
+ * 
+ * Returns 1 on success and -1 on failure.
+ */
+int workpool_submit(WorkPool_t *pool, WPJobFunc_t func, void *arg, int device_count, const dev_t *devices);
+
+/* Wait until all submitted jobs are finished.
+ */
+void workpool_wait(WorkPool_t *pool);
+
+/* Wait until all submitted jobs are finished, stop the workers and free
+ * all memory associated with the pool.
+ */
+void workpool_destroy(WorkPool_t *pool);
+
+/* Return the device that holds the named file, or 0 if it cannot be
+ * determined.
+ */
+dev_t workpool_device(const char *filename);
+
+#endif // WORKPOOL_H